@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+
+// a target for runBenchmark.sh, with a fixed set of threads that keep
+// running through the same few stacks, so after the first few samples
+// the profiler has seen everything it's going to see
+
+
+volatile double sink;
+
+
+void spinWork() {
+    for( int i=0; i<100000; i++ ) {
+        sink += sqrt( i );
+        }
+    }
+
+
+
+void *worker( void * /* inArg */ ) {
+    pthread_setname_np( pthread_self(), "worker" );
+
+    while( true ) {
+        spinWork();
+        }
+    return NULL;
+    }
+
+
+
+void *sleeper( void * /* inArg */ ) {
+    pthread_setname_np( pthread_self(), "sleeper" );
+
+    while( true ) {
+        usleep( 1000 );
+        }
+    return NULL;
+    }
+
+
+
+int main() {
+    pthread_t thread;
+
+    for( int i=0; i<3; i++ ) {
+        pthread_create( &thread, NULL, worker, NULL );
+        }
+    pthread_create( &thread, NULL, sleeper, NULL );
+
+    printf( "Benchmark target running on PID %d\n", (int)getpid() );
+
+    while( true ) {
+        sleep( 1 );
+        }
+    return 0;
+    }
@@ -0,0 +1,162 @@
+// feeds the profiler's GDB readers output that arrives in a single chunk,
+// a result followed by the async records that come after it, and checks
+// that the reader after the first one still sees those records
+
+#define main profilerMain
+#include "../wallClockProfiler.cpp"
+#undef main
+
+#include <signal.h>
+
+
+static const char *currentTest = "";
+
+
+static void handleAlarm( int /* inSignal */ ) {
+    // a reader is blocked waiting for output that was already read
+    printf( "FAIL:  %s (blocked reading GDB output)\n", currentTest );
+    exit( 1 );
+    }
+
+
+
+static int writeEnd;
+
+// replaces inPipe with a fresh pipe holding inChunk, written all at once
+static void feedChunk( const char *inChunk ) {
+    int fds[2];
+    if( pipe( fds ) == -1 ) {
+        printf( "Failed to make pipe\n" );
+        exit( 1 );
+        }
+
+    inPipe = fds[0];
+    writeEnd = fds[1];
+
+    fcntl( inPipe, F_SETFL, O_NONBLOCK );
+
+    write( writeEnd, inChunk, strlen( inChunk ) );
+
+    numPendingGDBBytes = 0;
+    programExited = false;
+    }
+
+
+static void closeChunk() {
+    close( inPipe );
+    close( writeEnd );
+    }
+
+
+
+static int numResultsSeen;
+
+static void countResult( char * /* inResult */, int /* inIndex */, 
+                         void * /* inContext */ ) {
+    numResultsSeen++;
+    }
+
+
+
+static int numFailed = 0;
+
+static void check( char inCondition, const char *inWhat ) {
+    if( ! inCondition ) {
+        printf( "FAIL:  %s:  %s\n", currentTest, inWhat );
+        numFailed++;
+        }
+    }
+
+
+
+int main() {
+    signal( SIGALRM, handleAlarm );
+
+
+    currentTest = "result, then *stopped for the interrupt";
+
+    feedChunk( "5^done,stack=[]\n"
+               "(gdb) \n"
+               "*stopped,reason=\"signal-received\",signal-name=\"SIGINT\","
+               "thread-id=\"1\"\n"
+               "(gdb) \n" );
+    alarm( 5 );
+
+    numResultsSeen = 0;
+    readGDBResults( 5, 1, countResult, NULL );
+    check( numResultsSeen == 1, "result not seen" );
+
+    waitForGDBInterruptResponse();
+    check( strstr( readBuff, "*stopped," ) != NULL, "*stopped not seen" );
+    check( ! programExited, "exit seen" );
+
+    alarm( 0 );
+    closeChunk();
+
+
+    currentTest = "result, then another thread's stop in non-stop mode";
+
+    feedChunk( "7^done\n"
+               "(gdb) \n"
+               "8^done\n"
+               "(gdb) \n"
+               "*stopped,reason=\"signal-received\",signal-name=\"0\","
+               "thread-id=\"3\"\n" );
+    alarm( 5 );
+
+    numResultsSeen = 0;
+    readGDBResults( 7, 1, countResult, NULL );
+    check( numResultsSeen == 1, "result not seen" );
+
+    check( waitForGDBThreadStop( 8, 3 ), "thread 3 stop not seen" );
+
+    alarm( 0 );
+    closeChunk();
+
+
+    currentTest = "result, then the target's exit";
+
+    feedChunk( "9^done\n"
+               "(gdb) \n"
+               "=thread-exited,id=\"2\",group-id=\"i1\"\n"
+               "=thread-group-exited,id=\"i1\",exit-code=\"0\"\n" );
+    alarm( 5 );
+
+    numResultsSeen = 0;
+    readGDBResults( 9, 1, countResult, NULL );
+    check( numResultsSeen == 1, "result not seen" );
+    check( ! programExited, "exit seen too early" );
+
+    readGDBResults( 10, 1, countResult, NULL );
+    check( programExited, "exit not seen" );
+
+    alarm( 0 );
+    closeChunk();
+
+
+    currentTest = "the target's exit, then what GDB says after it";
+
+    feedChunk( "=thread-group-exited,id=\"i1\",exit-code=\"0\"\n"
+               "*stopped,reason=\"exited-normally\"\n"
+               "(gdb) \n" );
+    alarm( 5 );
+
+    readGDBResults( 11, 1, countResult, NULL );
+    check( programExited, "exit not seen" );
+
+    waitForGDBInterruptResponse();
+    check( strstr( readBuff, "exited-normally" ) != NULL, 
+           "lines after the exit lost" );
+
+    alarm( 0 );
+    closeChunk();
+
+
+    if( numFailed > 0 ) {
+        printf( "%d checks failed\n", numFailed );
+        return 1;
+        }
+
+    printf( "All GDB read tests passed\n" );
+    return 0;
+    }
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+
+
+// loaded with LD_PRELOAD by runBenchmark.sh, counts every malloc, calloc
+// and realloc the profiler makes, through operator new or straight from
+// libc, and prints the total when it exits
+// glibc's own entry points are called, rather than ones found with
+// dlsym, since dlsym can allocate
+
+
+extern "C" {
+    void *__libc_malloc( size_t inSize );
+    void *__libc_calloc( size_t inCount, size_t inSize );
+    void *__libc_realloc( void *inPointer, size_t inSize );
+    }
+
+
+static std::atomic<long> numAllocations( 0 );
+
+
+
+extern "C" void *malloc( size_t inSize ) {
+    numAllocations.fetch_add( 1, std::memory_order_relaxed );
+    return __libc_malloc( inSize );
+    }
+
+
+
+extern "C" void *calloc( size_t inCount, size_t inSize ) {
+    numAllocations.fetch_add( 1, std::memory_order_relaxed );
+    return __libc_calloc( inCount, inSize );
+    }
+
+
+
+extern "C" void *realloc( void *inPointer, size_t inSize ) {
+    numAllocations.fetch_add( 1, std::memory_order_relaxed );
+    return __libc_realloc( inPointer, inSize );
+    }
+
+
+
+__attribute__(( destructor ))
+static void printAllocations() {
+    char line[64];
+    int length = snprintf( line, sizeof( line ), "%ld malloc calls\n",
+                           numAllocations.load() );
+
+    // stdout may already be closed
+    write( STDERR_FILENO, line, length );
+    }
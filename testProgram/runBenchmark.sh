@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Profiles benchTarget with the ptrace backend, asking for 10000 samples a
+# second, and prints how many samples were taken, how many allocations
+# the profiler made in all (counted by mallocCount.so), how many of those
+# were operator new calls while sampling, and how long it all took.
+#
+# Usage:
+#
+# ./runBenchmark.sh [seconds] [profiler source]
+#
+# seconds defaults to 100, which comes to about 100k samples.  The source
+# defaults to ../wallClockProfiler.cpp, and can be an older version of it,
+# to compare against:
+#
+# git show <commit>:wallClockProfiler.cpp > oldProfiler.cpp
+# ./runBenchmark.sh 100 oldProfiler.cpp
+
+
+seconds=${1:-100}
+source=${2:-../wallClockProfiler.cpp}
+
+cd "$(dirname "$0")"
+
+g++ -O2 -o benchProfiler "$source" -lpthread || exit 1
+g++ -O2 -o benchTarget benchTarget.cpp -lpthread || exit 1
+g++ -O2 -shared -fPIC -o mallocCount.so mallocCount.cpp || exit 1
+
+
+./benchTarget > /dev/null &
+targetPID=$!
+
+# let its threads start
+sleep 1
+
+
+start=$(date +%s.%N)
+
+LD_PRELOAD=./mallocCount.so \
+    ./benchProfiler --backend ptrace 10000 ./benchTarget $targetPID $seconds \
+    > benchReport.txt 2> benchAllocations.txt
+
+end=$(date +%s.%N)
+
+kill $targetPID
+
+
+echo "Profiler source:  $source"
+
+grep -E "samples taken|thread stacks sampled|unique stacks|Target paused" \
+    benchReport.txt
+grep -E "operator new calls|heap allocations" benchReport.txt
+grep "malloc calls" benchAllocations.txt
+
+echo "$start $end" | awk '{ printf( "%.3f seconds in all\n", $2 - $1 ) }'
+
+echo "Full report in benchReport.txt"
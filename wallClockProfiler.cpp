@@ -10,8 +10,27 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <dirent.h>
+#include <ucontext.h>
+#include <termios.h>
+#include <elf.h>
+#include <link.h>
+#include <cxxabi.h>
 
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
 #include <string>
 #include <iostream>
 #include <vector>
@@ -41,11 +60,21 @@ class SimpleVector {
         // assignment operator
         SimpleVector & operator = (const SimpleVector &inOther );
         
+        
+        // move constructor and assignment, which take inOther's elements
+        // without copying them, leaving it empty
+        SimpleVector( SimpleVector &&inOther );
+        SimpleVector & operator = ( SimpleVector &&inOther );
+        
 
 
 		
 		void push_back(Type x);		// add x to the end of the vector
 
+        // adds a default element to the end of the vector and returns it,
+        // so it can be filled in where it sits instead of being copied in
+        Type *emplace_back();
+
         // add array of elements to the end of the vector
 		void push_back(Type *inArray, int inLength);		
 
@@ -324,6 +353,48 @@ inline SimpleVector<Type> & SimpleVector<Type>::operator = (
 
 
 
+// move constructor
+template <class Type>
+inline SimpleVector<Type>::SimpleVector( SimpleVector<Type> &&inOther )
+        : elements( inOther.elements ),
+          numFilledElements( inOther.numFilledElements ),
+          maxSize( inOther.maxSize ), minSize( inOther.minSize ),
+          printExpansionMessage( inOther.printExpansionMessage ),
+          vectorName( inOther.vectorName ) {
+    
+    // push_back gives it space again if it's used after this
+    inOther.elements = NULL;
+    inOther.numFilledElements = 0;
+    inOther.maxSize = 0;
+    }
+
+
+
+// move assignment operator
+template <class Type>
+inline SimpleVector<Type> & SimpleVector<Type>::operator = (
+    SimpleVector<Type> &&inOther ) {
+    
+    if( this != &inOther ) {
+        delete [] elements;
+        
+        elements = inOther.elements;
+        numFilledElements = inOther.numFilledElements;
+        maxSize = inOther.maxSize;
+        minSize = inOther.minSize;
+        printExpansionMessage = inOther.printExpansionMessage;
+        vectorName = inOther.vectorName;
+        
+        inOther.elements = NULL;
+        inOther.numFilledElements = 0;
+        inOther.maxSize = 0;
+        }
+    
+    return *this;
+    }
+
+
+
 
 
 
@@ -388,7 +459,7 @@ inline bool SimpleVector<Type>::deleteElement(int index) {
 
 
             for( int i=index+1; i<numFilledElements; i++ ) {
-                elements[i - 1] = elements[i];
+                elements[i - 1] = std::move( elements[i] );
                 }
 			}
 			
@@ -414,7 +485,7 @@ inline bool SimpleVector<Type>::deleteStartElements( int inNumToDelete ) {
             // destroyed.
 
             for( int i=inNumToDelete; i<numFilledElements; i++ ) {
-                elements[i - inNumToDelete] = elements[i];
+                elements[i - inNumToDelete] = std::move( elements[i] );
                 }
 			}
 			
@@ -501,9 +572,9 @@ inline void SimpleVector<Type>::swap( int inA, int inB ) {
     
     if( inA < numFilledElements && inA >= 0 &&
         inB < numFilledElements && inB >= 0 ) {
-        Type temp = elements[ inA ];
-        elements[ inA ] = elements[ inB ];
-        elements[ inB ] = temp;
+        Type temp = std::move( elements[ inA ] );
+        elements[ inA ] = std::move( elements[ inB ] );
+        elements[ inB ] = std::move( temp );
         }
     }
 
@@ -539,13 +610,18 @@ inline void SimpleVector<Type>::deleteAll() {
 template <class Type>
 inline void SimpleVector<Type>::push_back(Type x)	{
 	if( numFilledElements < maxSize) {	// still room in vector
-		elements[numFilledElements] = x;
+		elements[numFilledElements] = std::move( x );
 		numFilledElements++;
 		}
 	else {					// need to allocate more space for vector
 
 		int newMaxSize = maxSize << 1;		// double size
 		
+        if( newMaxSize == 0 ) {
+            // moved from
+            newMaxSize = ( minSize > 0 ) ? minSize : defaultStartSize;
+            }
+		
         if( printExpansionMessage ) {
             printf( "SimpleVector \"%s\" is expanding itself from %d to %d"
                     " max elements\n", vectorName, maxSize, newMaxSize );
@@ -568,8 +644,10 @@ inline void SimpleVector<Type>::push_back(Type x)	{
 		*/
 
         // must use element-by-element assignment to invoke constructors
+        // but the old elements are about to be deleted, so they can be
+        // moved rather than copied
         for( int i=0; i<numFilledElements; i++ ) {
-            newAlloc[i] = elements[i];
+            newAlloc[i] = std::move( elements[i] );
             }
         
 
@@ -579,12 +657,22 @@ inline void SimpleVector<Type>::push_back(Type x)	{
 		elements = newAlloc;
 		maxSize = newMaxSize;	
 		
-		elements[numFilledElements] = x;
+		elements[numFilledElements] = std::move( x );
 		numFilledElements++;	
 		}
 	}
 
 
+
+template <class Type>
+inline Type *SimpleVector<Type>::emplace_back() {
+    // slots past the end can hold leftovers from shrink or deleteElement
+    push_back( Type() );
+    
+    return &( elements[ numFilledElements - 1 ] );
+    }
+
+
 template <class Type>
 inline void SimpleVector<Type>::push_front(Type x)	{
     push_middle( x, 0 );
@@ -600,11 +688,11 @@ inline void SimpleVector<Type>::push_middle( Type x, int inNumBefore )	{
     
     // now shift all of the "after" elements forward
     for( int i=numFilledElements-2; i>=inNumBefore; i-- ) {
-        elements[i+1] = elements[i];
+        elements[i+1] = std::move( elements[i] );
         }
     
     // finally, re-insert in middle spot
-    elements[inNumBefore] = x;
+    elements[inNumBefore] = std::move( x );
     }
 
 
@@ -924,12 +1012,112 @@ static void usage() {
             "    wallClockProfiler samples_per_sec ./myProgram pid "
             "[detatch_sec]\n\n" );
     printf( "detatch_sec is the (optional) number of seconds before detatching and\n"
-            "ending profiling (or -1 to stay attached forever, default)\n\n" );
-    
+            "ending profiling (or -1 to stay attached forever, default)\n"
+            "it can be fractional, like 0.5\n\n" );
+    printf( "Options (must come before samples_per_sec):\n\n"
+            "    --backend gdb|ptrace   sample through GDB (default), or stop\n"
+            "                           the target directly with ptrace and\n"
+            "                           walk its stack without GDB\n"
+            "    --defer-symbols        record only frame addresses while\n"
+            "                           sampling and name them all once at\n"
+            "                           the end (always on with ptrace)\n"
+            "    --non-stop             with GDB, stop one thread at a time\n"
+            "                           to sample it, while the rest keep\n"
+            "                           running\n"
+            "    --partial-depth N      report partial stacks down to N\n"
+            "                           frames from the outermost (default\n"
+            "                           14, 0 for none)\n"
+            "    --partial-threshold N  only report partial stacks with at\n"
+            "                           least N samples (default 2)\n"
+            "    --max-depth N          keep at most N frames of a stack,\n"
+            "                           with the rest replaced by one\n"
+            "                           [truncated] frame (default 1024)\n"
+            "    --jitter N             move each sample earlier or later\n"
+            "                           by up to N%% of the interval (0-50)\n"
+            "    --poisson              space samples randomly, with the\n"
+            "                           same average rate\n"
+            "    --max-overhead P       sample more slowly than\n"
+            "                           samples_per_sec when needed to keep\n"
+            "                           the target paused for at most P%%\n"
+            "                           of the time\n"
+            "    --record file          also write every sample to file,\n"
+            "                           for the report subcommand\n"
+            "    --snapshot file        write the report so far to file\n"
+            "                           every so often while sampling\n"
+            "    --snapshot-every N     seconds between snapshots, and\n"
+            "                           between flushes of a recording\n"
+            "                           (default 10)\n"
+            "    --live                 show the hottest functions and\n"
+            "                           stacks so far, redrawn while\n"
+            "                           sampling, instead of waiting for\n"
+            "                           the report\n"
+            "    --daemon dir           write a report for each window of\n"
+            "                           time to its own file in dir, and\n"
+            "                           free what was logged in it\n"
+            "    --window N             seconds in a window (default 60)\n"
+            "    --max-memory MB        end a window early once what's\n"
+            "                           logged in it takes up more than\n"
+            "                           MB megabytes (default 64)\n"
+            "    --keep N               keep only the newest N window\n"
+            "                           files (default 1440)\n\n" );
+    printf( "Report from a recording:\n\n"
+            "    wallClockProfiler report file\n\n" );
+
     exit( 1 );
     }
 
 
+
+// true if we sample with our own ptrace backend instead of through GDB
+char useNativeBackend = false;
+
+// true if samples only record frame addresses, with function names
+// looked up once per unique address after sampling ends
+char deferSymbols = false;
+
+// with --record, where samples are written
+char *recordingPath = NULL;
+
+// with --snapshot, where the report so far is written while sampling
+char *snapshotPath = NULL;
+
+// seconds between snapshots, or -1 for none
+double snapshotSeconds = -1;
+
+// true to draw the live view in the terminal while sampling
+char liveView = false;
+
+// true if the report can't ask GDB for anything, for the report 
+// subcommand and for snapshots, which GDB is busy sampling through
+char reportWithoutGDB = false;
+
+// true if GDB runs the target in non-stop mode, where we interrupt and
+// sample one thread at a time instead of freezing all of them
+char nonStopMode = false;
+
+// partial stacks are reported down to this many frames from the 
+// outermost, for those with at least this many samples
+int partialStackDepth = 14;
+int partialStackThreshold = 2;
+
+// frames past this many from the innermost aren't captured, and a stack 
+// that had more ends in a [truncated] frame instead
+int maxStackDepth = 1024;
+
+// each sample is moved off its fixed slot by up to this percent of the 
+// interval, either way, so we don't keep landing on the same phase of 
+// periodic work in the target
+int sampleJitterPercent = 0;
+
+// true to space samples by exponentially distributed gaps instead, 
+// which makes them a Poisson process
+char poissonSampling = false;
+
+// if positive, samples are slowed down from the rate asked for as needed
+// to keep the target paused for no more than this percent of the time
+double maxOverheadPercent = -1;
+
+
 int inPipe;
 int outPipe;
 
@@ -950,6 +1138,15 @@ static void log( const char *inHeader, char *inBody ) {
 
 
 
+static void closeLogFile() {
+    if( logFile != NULL ) {
+        fclose( logFile );
+        logFile = NULL;
+        }
+    }
+
+
+
 static void sendCommand( const char *inCommand ) {
     log( "Sending command to GDB", (char*)inCommand );
 
@@ -958,77 +1155,423 @@ static void sendCommand( const char *inCommand ) {
     }
 
 
-// 65 KiB buffer
-// if GDB issues a single response that is longer than this
-// we will only return or processes the tail end of it.
+// starts at 64 KiB, and doubles whenever a single response (or, for
+// readGDBLines, a single line) doesn't fit, so a deep stack comes 
+// through whole
 #define READ_BUFF_SIZE 65536
-char readBuff[READ_BUFF_SIZE];
+char *readBuff = NULL;
+int readBuffSize = 0;
 
 char anythingInReadBuff = false;
 char numReadAttempts = 0;
 
+// readGDBLines can stop partway through what it read, so the lines after
+// the one it stopped at wait at the start of readBuff, and the next read
+// of GDB output starts with them
+int numPendingGDBBytes = 0;
+
+
 
-#define BUFF_TAIL_SIZE 32768
-char tailBuff[ BUFF_TAIL_SIZE ];
+// allocates readBuff, or doubles it, keeping its first inNumUsed bytes
+static void growReadBuff( int inNumUsed ) {
+    int newSize = readBuffSize == 0 ? READ_BUFF_SIZE : readBuffSize * 2;
+    
+    char *newBuff = new char[ newSize ];
+    
+    if( readBuff != NULL ) {
+        memcpy( newBuff, readBuff, inNumUsed );
+        delete [] readBuff;
+        }
+    
+    readBuff = newBuff;
+    readBuffSize = newSize;
+    }
 
 
 char programExited = false;
 char detatchJustSent = false;
 
 
-static int fillBufferWithResponse( const char *inWaitingFor = NULL ) {
-    int readSoFar = 0;
-    anythingInReadBuff = false;
-    numReadAttempts = 0;
+
+// how long the target was stopped for each sample, in microseconds
+// in non-stop mode, that's one per thread stopped
+// kept as a histogram rather than a list, so logging a pause never
+// allocates:  exact below 256 usec, then 32 buckets per power of two,
+// which is within about 3%
+#define NUM_EXACT_PAUSE_BUCKETS 256
+#define PAUSE_SUB_BUCKET_BITS 5
+#define NUM_PAUSE_BUCKETS \
+    ( NUM_EXACT_PAUSE_BUCKETS + ( 31 - 8 ) * ( 1 << PAUSE_SUB_BUCKET_BITS ) )
+
+int pauseBuckets[ NUM_PAUSE_BUCKETS ];
+int numPauses = 0;
+double totalPauseTime = 0;
+int longestPause = 0;
+
+// held while a pause is logged, so the worker can print a snapshot's 
+// pause report while the sampling thread goes on logging them
+std::mutex pauseStatsLock;
+
+// true if reports cover less than the whole session, so they should say 
+// that these don't
+char pauseReportSinceStart = false;
+
+// total of the pauses in the sample being taken
+double samplePauseTime = 0;
+
+
+static double getMicroseconds() {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
     
-    while( true ) {
+    return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+    }
+
+
+
+static int getPauseBucket( int inMicroseconds ) {
+    if( inMicroseconds < NUM_EXACT_PAUSE_BUCKETS ) {
+        return inMicroseconds < 0 ? 0 : inMicroseconds;
+        }
+    // at least 8, since 256 is 2^8
+    int exponent = 31 - __builtin_clz( inMicroseconds );
+    int shift = exponent - PAUSE_SUB_BUCKET_BITS;
+    
+    int subBucket = 
+        ( inMicroseconds >> shift ) & ( ( 1 << PAUSE_SUB_BUCKET_BITS ) - 1 );
+    
+    return NUM_EXACT_PAUSE_BUCKETS + 
+        ( ( exponent - 8 ) << PAUSE_SUB_BUCKET_BITS ) + subBucket;
+    }
+
+
+
+// the middle of the range of times in inBucket
+static int getPauseBucketTime( int inBucket ) {
+    if( inBucket < NUM_EXACT_PAUSE_BUCKETS ) {
+        return inBucket;
+        }
+    inBucket -= NUM_EXACT_PAUSE_BUCKETS;
+    
+    int shift = ( inBucket >> PAUSE_SUB_BUCKET_BITS ) + 8 - 
+        PAUSE_SUB_BUCKET_BITS;
+    int subBucket = inBucket & ( ( 1 << PAUSE_SUB_BUCKET_BITS ) - 1 );
+    
+    int low = ( ( 1 << PAUSE_SUB_BUCKET_BITS ) + subBucket ) << shift;
+    
+    return low + ( ( 1 << shift ) >> 1 );
+    }
+
+
+
+static void logPause( double inStartTime ) {
+    int time = lrint( getMicroseconds() - inStartTime );
+    
+    pauseStatsLock.lock();
+    
+    pauseBuckets[ getPauseBucket( time ) ]++;
+    numPauses++;
+    totalPauseTime += time;
+    samplePauseTime += time;
+    
+    if( time > longestPause ) {
+        longestPause = time;
+        }
+    
+    pauseStatsLock.unlock();
+    }
+
+
+
+// the time below which inPercent of the pauses fell
+static int getPausePercentile( int inPercent ) {
+    // same index a sorted list of the times would have
+    int rank = (int)( ( (long)numPauses * inPercent ) / 100 );
+    int seen = 0;
+    
+    for( int i=0; i<NUM_PAUSE_BUCKETS; i++ ) {
+        seen += pauseBuckets[i];
         
-        if( readSoFar >= READ_BUFF_SIZE - 1 ) {
-            // we've filled up our read buffer
+        if( seen > rank ) {
+            int time = getPauseBucketTime( i );
             
-            // save the last bit of it, but discard the rest
-            
-            // copy end, including last \0
-            memcpy( tailBuff, 
-                    &( readBuff[ readSoFar + 1 - BUFF_TAIL_SIZE ] ),
-                    BUFF_TAIL_SIZE );
-            
-            memcpy( readBuff, tailBuff, BUFF_TAIL_SIZE );
-
-            readSoFar = BUFF_TAIL_SIZE - 1;
+            // never report more than we actually saw
+            return time < longestPause ? time : longestPause;
             }
+        }
+    return longestPause;
+    }
+
+
+
+// where reports are printed, which is stdout except while a snapshot or
+// a window's report is written to its file
+FILE *reportFile = stdout;
+
+
+
+static void printPauseReport() {
+    // copied out, so the sampling thread isn't held up by the printing
+    pauseStatsLock.lock();
+    
+    int pauses = numPauses;
+    double averagePause = 0;
+    int medianPause = 0;
+    int pause99 = 0;
+    int longest = longestPause;
+    
+    if( pauses > 0 ) {
+        averagePause = totalPauseTime / pauses;
+        medianPause = getPausePercentile( 50 );
+        pause99 = getPausePercentile( 99 );
+        }
+    
+    pauseStatsLock.unlock();
+    
+    if( pauses == 0 ) {
+        return;
+        }
+    
+    fprintf( reportFile, "Target paused for %.0f usec per %s on average%s "
+             "(median %d, 99th percentile %d, longest %d)\n",
+             averagePause,
+             nonStopMode ? "thread sampled" : "sample",
+             pauseReportSinceStart ? " since sampling started" : "",
+             medianPause,
+             pause99,
+             longest );
+    
+    if( nonStopMode ) {
+        fprintf( reportFile, "Only the thread being sampled was stopped, "
+                 "the rest kept running\n" );
+        }
+    else {
+        fprintf( reportFile, "All threads were stopped during each sample\n" );
+        }
+    }
+
+
+// samples are taken on a fixed cadence of absolute deadlines, so the
+// time a sample takes comes out of the wait for the next one instead of
+// adding to it
+
+// microseconds between samples
+double sampleInterval = 10000;
+
+// the interval asked for, which --max-overhead only ever lengthens
+double minSampleInterval = 10000;
+
+// moving average of how long each sample paused the target, or -1 
+// before the first one
+double averageSamplePause = -1;
+
+// the unjittered time of the last deadline handed out
+double sampleSlotTime = 0;
+
+double sampleScheduleStartTime = 0;
+
+
+
+// a random number in ( 0, 1 )
+static double getRandomFraction() {
+    return ( random() + 1.0 ) / ( RAND_MAX + 2.0 );
+    }
+
+
+
+// starts the cadence, with the first deadline one interval from now
+static void startSampleSchedule( double inSamplesPerSecond ) {
+    sampleInterval = 1000000 / inSamplesPerSecond;
+    minSampleInterval = sampleInterval;
+    sampleSlotTime = getMicroseconds();
+    sampleScheduleStartTime = sampleSlotTime;
+    
+    srandom( (unsigned int)( getpid() ^ (long)sampleSlotTime ) );
+    }
+
+
+
+// returns when, on the getMicroseconds clock, to take the next sample
+static double getNextSampleDeadline() {
+    if( poissonSampling ) {
+        sampleSlotTime += -log( getRandomFraction() ) * sampleInterval;
+        }
+    else {
+        sampleSlotTime += sampleInterval;
+        }
+    
+    double now = getMicroseconds();
+    
+    if( sampleSlotTime < now ) {
+        // a sample ran past the next one's slot, so start over from
+        // here rather than taking the missed ones back to back
+        sampleSlotTime = now;
+        }
+    
+    if( maxOverheadPercent > 0 ) {
+        // not before the pauses so far fit in the budget, which the 
+        // average alone can overshoot when a few samples take much 
+        // longer than the rest
+        double earliest = sampleScheduleStartTime + 
+            totalPauseTime * 100 / maxOverheadPercent;
         
-        numReadAttempts++;
+        if( sampleSlotTime < earliest ) {
+            sampleSlotTime = earliest;
+            }
+        }
+    
+    if( sampleJitterPercent > 0 ) {
+        double maxShift = sampleInterval * sampleJitterPercent / 100;
         
-        int numRead = 
-            read( inPipe, &( readBuff[readSoFar] ), 
-                  ( READ_BUFF_SIZE - 1 ) - readSoFar );
+        return sampleSlotTime + 
+            ( 2 * getRandomFraction() - 1 ) * maxShift;
+        }
+    return sampleSlotTime;
+    }
+
+
+
+// with --max-overhead, sets the interval so that a sample that pauses 
+// the target for as long as recent ones did takes up the allowed share
+// of it
+static void adjustSampleInterval( double inPauseTime ) {
+    if( maxOverheadPercent <= 0 ) {
+        return;
+        }
+    
+    if( averageSamplePause < 0 ) {
+        averageSamplePause = inPauseTime;
+        }
+    else {
+        // about the last eight samples
+        averageSamplePause += ( inPauseTime - averageSamplePause ) / 8;
+        }
+    
+    sampleInterval = averageSamplePause * 100 / maxOverheadPercent;
+    
+    if( sampleInterval < minSampleInterval ) {
+        sampleInterval = minSampleInterval;
+        }
+    }
+
+
+
+static void sleepUntil( double inDeadline ) {
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)( inDeadline / 1000000 );
+    deadline.tv_nsec = 
+        (long)( ( inDeadline - deadline.tv_sec * 1000000.0 ) * 1000 );
+    
+    // returns the error rather than setting errno
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, 
+                            &deadline, NULL ) == EINTR ) {
+        }
+    }
+
+
+
+// blocks until GDB has written something for us to read
+static void waitForGDBOutput() {
+    struct pollfd gdbOutput;
+    gdbOutput.fd = inPipe;
+    gdbOutput.events = POLLIN;
+    
+    while( poll( &gdbOutput, 1, -1 ) == -1 && errno == EINTR ) {
+        }
+    }
+
+
+
+// reads from GDB until it has printed its prompt, and inWaitingFor if
+// that's set
+// each read only searches the bytes it added, plus enough of the old
+// ones to catch a marker that was split across reads
+static int fillBufferWithResponse( const char *inWaitingFor = NULL ) {
+    int readSoFar = numPendingGDBBytes;
+    numPendingGDBBytes = 0;
+    anythingInReadBuff = ( readSoFar > 0 );
+    numReadAttempts = 0;
+    
+    const char *promptMarker = "(gdb)";
+    const char *exitMarker = "thread-group-exited";
+    const char *problemMarker = 
+        "A problem internal to GDB has been detected";
+    
+    int markerOverlap = strlen( problemMarker ) - 1;
+    
+    if( inWaitingFor != NULL && 
+        (int)strlen( inWaitingFor ) > markerOverlap ) {
+        markerOverlap = strlen( inWaitingFor ) - 1;
+        }
+    
+    int scannedTo = 0;
+    char sawPrompt = false;
+    char sawWaitingFor = ( inWaitingFor == NULL );
+    
+    if( readBuff == NULL ) {
+        growReadBuff( 0 );
+        }
+    
+    while( true ) {
         
-        if( numRead > 0 ) {
-            anythingInReadBuff = true;
+        // search what was added, starting with any pending bytes, before
+        // reading more
+        if( readSoFar > scannedTo ) {
+            readBuff[ readSoFar ] = '\0';
             
-            readSoFar += numRead;
+            int scanStart = scannedTo - markerOverlap;
+            if( scanStart < 0 ) {
+                scanStart = 0;
+                }
+            char *newText = &( readBuff[ scanStart ] );
             
-            readBuff[ readSoFar ] = '\0';
+            scannedTo = readSoFar;
+            
+            if( ! sawPrompt && strstr( newText, promptMarker ) != NULL ) {
+                sawPrompt = true;
+                }
+            if( ! sawWaitingFor && 
+                strstr( newText, inWaitingFor ) != NULL ) {
+                sawWaitingFor = true;
+                }
         
-            if( strstr( readBuff, "(gdb)" ) != NULL &&
-                ( inWaitingFor == NULL ||
-                  strstr( readBuff, inWaitingFor ) != NULL ) ) {
+            if( sawPrompt && sawWaitingFor ) {
                 // read full response
                 return readSoFar;
                 }
             else if( readSoFar > 10 &&
                      ! detatchJustSent &&
-                     strstr( readBuff, "thread-group-exited" ) != NULL ) {
+                     strstr( newText, exitMarker ) != NULL ) {
                 // stop waiting for full response, program has exited
                 programExited = true;
                 return readSoFar;
             } else if( readSoFar > 10 &&
-                     strstr( readBuff, "A problem internal to GDB has been detected" ) != NULL ) {
+                     strstr( newText, problemMarker ) != NULL ) {
                 programExited = true;
                 return readSoFar;
                 }
             }
+        
+        if( readSoFar >= readBuffSize - 1 ) {
+            growReadBuff( readSoFar );
+            }
+        
+        numReadAttempts++;
+        
+        int numRead = 
+            read( inPipe, &( readBuff[readSoFar] ), 
+                  ( readBuffSize - 1 ) - readSoFar );
+        
+        if( numRead > 0 ) {
+            anythingInReadBuff = true;
+            
+            readSoFar += numRead;
+            }
+        else if( numRead == 0 ) {
+            // GDB closed its end, so nothing more is coming
+            programExited = true;
+            return readSoFar;
+            }
         else if( numRead == -1 ) {
             if( !( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
                 char *errorString = strerror( errno );
@@ -1036,8 +1579,7 @@ static int fillBufferWithResponse( const char *inWaitingFor = NULL ) {
                 return readSoFar;
                 }
             else {
-                // sleep to avoid CPU starving pipe sender
-                usleep( 200 );
+                waitForGDBOutput();
                 }
             }
         }
@@ -1141,540 +1683,8961 @@ static char *getGDBResponse() {
 
 
 
-typedef struct StackFrame{
-        void *address;
-        char *funcName;
-        char *fileName;
-        int lineNum;
-    } StackFrame;
-
-
-typedef struct Stack {
-        SimpleVector<StackFrame> frames;
-        int sampleCount;
-    } Stack;
-
+// every allocation made with new, counted so the summary can show that
+// sampling stops allocating once it has seen a program's stacks
+// what libc allocates with malloc on its own, like fopen's buffer or
+// __cxa_demangle's result, isn't counted
+// per thread, so the sampling and worker threads can each tell what 
+// they allocated
+thread_local long numHeapAllocations = 0;
 
 
-typedef struct FunctionRecord {
-        char *funcName;
-        int sampleCount;
-    } FunctionRecord;
+// none of these are inlined, since GCC then sees malloc and free paired
+// with new and delete and warns
+__attribute__(( noinline ))
+void *operator new( size_t inSize ) {
+    numHeapAllocations++;
     
+    void *pointer = malloc( inSize == 0 ? 1 : inSize );
     
+    if( pointer == NULL ) {
+        throw std::bad_alloc();
+        }
+    return pointer;
+    }
 
 
-SimpleVector<Stack> stackLog;
+__attribute__(( noinline ))
+void *operator new[]( size_t inSize ) {
+    return operator new( inSize );
+    }
 
 
-// these are for counting repeated common stack roots
-// they do NOT need to be freed (they cointain poiters to strings
-// in the main stack log)
-#define NUM_ROOT_STACKS_TO_TRACK 15
-SimpleVector<Stack> stackRootLog[ NUM_ROOT_STACKS_TO_TRACK ];
+// all of the forms, so none of them can pair with a library version
+__attribute__(( noinline ))
+void operator delete( void *inPointer ) noexcept {
+    free( inPointer );
+    }
 
 
+__attribute__(( noinline ))
+void operator delete[]( void *inPointer ) noexcept {
+    free( inPointer );
+    }
 
 
-// does not make sense to call this unless depth less than full stack depth
-Stack getRoot( Stack inFullStack, int inDepth ) {
-    Stack newStack;
-    newStack.sampleCount = 1;
-    int numToSkip = inFullStack.frames.size() - inDepth;
-    
-    for( int i=numToSkip; i<inFullStack.frames.size(); i++ ) {
-        newStack.frames.push_back( inFullStack.frames.getElementDirect( i ) );
-        }
-    
-    return newStack;
+__attribute__(( noinline ))
+void operator delete( void *inPointer, size_t /* inSize */ ) noexcept {
+    free( inPointer );
     }
 
 
+__attribute__(( noinline ))
+void operator delete[]( void *inPointer, size_t /* inSize */ ) noexcept {
+    free( inPointer );
+    }
 
 
 
-static char stackCompare( Stack *inA, Stack *inB ) {
-    if( inA->frames.size() != inB->frames.size() ) {
-        return false;
-        }
-    for( int i=0; i<inA->frames.size(); i++ ) {
-        if( inA->frames.getElementDirect( i ).address !=
-            inB->frames.getElementDirect( i ).address ) {
-            return false;
-            }    
-        }
-    return true;
-    }
+// a bump allocator:  allocations are carved off the end of a block, and 
+// are only freed all at once
+typedef struct Arena {
+        char *block;
+        int blockSize;
+        int used;
+        // bytes used in fullBlocks
+        int fullBytes;
+        // blocks that filled up before this one
+        SimpleVector<char *> fullBlocks;
+    } Arena;
 
 
-static void freeStack( Stack *inStack ) {
-    for( int i=0; i<inStack->frames.size(); i++ ) {
-        StackFrame f = inStack->frames.getElementDirect( i );
-        delete [] f.funcName;
-        delete [] f.fileName;
-        }
-    inStack->frames.deleteAll();
-    }
+#define ARENA_BLOCK_SIZE 65536
 
 
+// frames of the stacks we keep, which live until the report is done
+Arena stackArena = { NULL, 0, 0, 0, SimpleVector<char *>() };
+
+// the worker thread's temporaries for the sample it's logging, like 
+// parsed frames, reset after each sample
+Arena workerArena = { NULL, 0, 0, 0, SimpleVector<char *>() };
+
+
+
+static void *arenaAlloc( Arena *ioArena, int inBytes ) {
+    // nothing we keep in them needs more than 8-byte alignment
+    inBytes = ( inBytes + 7 ) & ~7;
+    
+    if( ioArena->used + inBytes > ioArena->blockSize ) {
+        if( ioArena->block != NULL ) {
+            ioArena->fullBlocks.push_back( ioArena->block );
+            ioArena->fullBytes += ioArena->used;
+            }
+        
+        int blockSize = ARENA_BLOCK_SIZE;
+        while( blockSize < inBytes ) {
+            blockSize *= 2;
+            }
+        ioArena->block = new char[ blockSize ];
+        ioArena->blockSize = blockSize;
+        ioArena->used = 0;
+        }
+    
+    void *pointer = &( ioArena->block[ ioArena->used ] );
+    ioArena->used += inBytes;
+    
+    return pointer;
+    }
+
+
+
+static char *arenaStringDuplicate( Arena *ioArena, const char *inString ) {
+    int length = strlen( inString );
+    
+    char *copy = (char *)arenaAlloc( ioArena, length + 1 );
+    memcpy( copy, inString, length + 1 );
+    
+    return copy;
+    }
+
+
+
+static void freeArenaBlocks( Arena *ioArena ) {
+    for( int i=0; i<ioArena->fullBlocks.size(); i++ ) {
+        delete [] ioArena->fullBlocks.getElementDirect( i );
+        }
+    ioArena->fullBlocks.shrink( 0 );
+    ioArena->fullBytes = 0;
+    
+    if( ioArena->block != NULL ) {
+        delete [] ioArena->block;
+        }
+    ioArena->block = NULL;
+    ioArena->blockSize = 0;
+    ioArena->used = 0;
+    }
+
+
+
+// frees everything in the arena for reuse
+// if it took more than one block, they're replaced by one block that 
+// holds all of it, so the same work next time doesn't allocate
+static void resetArena( Arena *ioArena ) {
+    if( ioArena->fullBlocks.size() > 0 ) {
+        int totalBytes = ioArena->fullBytes + ioArena->used;
+        
+        freeArenaBlocks( ioArena );
+        
+        // next alloc gets a block at least this big
+        arenaAlloc( ioArena, totalBytes );
+        }
+    ioArena->used = 0;
+    }
+
+
+
+static void freeArena( Arena *ioArena ) {
+    freeArenaBlocks( ioArena );
+    ioArena->fullBlocks.deleteAll();
+    }
+
+
+
+// **************************************
+// the sample pipeline
+
+// the sampling thread copies what it captures into a ring, as raw 
+// -stack-list-frames results or unwound native frames, and resumes the 
+// target right away
+// a worker thread parses and logs them from there, so none of that 
+// bookkeeping happens while the target is stopped
+// one producer and one consumer, so the ring only needs the two 
+// positions below, each written by one side
+
+
+// what a record in the ring holds, after its header
+typedef enum SampleRecordKind {
+    // a -stack-list-frames result line, \0-terminated
+    GDB_STACK_RECORD,
+    // an array of StackFrames
+    NATIVE_STACK_RECORD,
+    // nothing, marks the end of a sample's records
+    SAMPLE_END_RECORD,
+    // nothing, the next record is at the start of the ring
+    RING_WRAP_RECORD,
+    // nothing, the worker stops after this
+    PIPELINE_STOP_RECORD
+    } SampleRecordKind;
+
+
+typedef struct SampleRecord {
+        int kind;
+        int threadID;
+        // the thread's \0-terminated name follows the header, padded to
+        // 8 bytes, then the data
+        int nameSize;
+        int dataSize;
+        // for SAMPLE_END_RECORD, what capturing the sample allocated on 
+        // the sampling thread, and how long it paused the target, in 
+        // microseconds
+        long captureAllocations;
+        long pauseTime;
+        // when the sample began, in microseconds
+        long sampleTime;
+    } SampleRecord;
+
+
+// big enough for a few samples of any size we can capture
+#define SAMPLE_RING_SIZE ( 4 * 1024 * 1024 )
+
+char *sampleRing = NULL;
+
+// in bytes since the start, so they never wrap, and the ring is empty
+// when they're equal
+// ringWritten is advanced by the sampling thread, ringRead by the worker
+std::atomic<long> ringWritten( 0 );
+std::atomic<long> ringRead( 0 );
+
+// posted once per SAMPLE_END_RECORD or PIPELINE_STOP_RECORD
+sem_t ringSamplesReady;
+
+// the sampling thread's record in progress
+long ringRecordStart;
+long ringRecordEnd;
+
+// when the sample being taken began, for the records it puts in the ring
+long sampleStartTime = 0;
+
+
+
+static int alignRecordSize( int inSize ) {
+    return ( inSize + 7 ) & ~7;
+    }
+
+
+
+// starts a record in the ring
+// returns where inDataSize bytes of data go, which are only seen by the
+// worker after commitRingRecord
+// if the worker has fallen a whole ring behind, waits for room if inWait
+// is set, or returns NULL
+static void *beginRingRecord( int inKind, int inThreadID, 
+                              const char *inThreadName, int inDataSize,
+                              char inWait ) {
+    int nameSize = alignRecordSize( strlen( inThreadName ) + 1 );
+    int recordSize = 
+        sizeof( SampleRecord ) + nameSize + alignRecordSize( inDataSize );
+    
+    long start = ringWritten.load( std::memory_order_relaxed );
+    long offset = start % SAMPLE_RING_SIZE;
+    
+    // records don't wrap, so skip to the start if it doesn't fit
+    long skip = 0;
+    if( offset + recordSize > SAMPLE_RING_SIZE ) {
+        skip = SAMPLE_RING_SIZE - offset;
+        }
+    
+    while( start + skip + recordSize - 
+           ringRead.load( std::memory_order_acquire ) > SAMPLE_RING_SIZE ) {
+        if( ! inWait ) {
+            return NULL;
+            }
+        usleep( 100 );
+        }
+    
+    if( skip > 0 ) {
+        if( skip >= (long)sizeof( SampleRecord ) ) {
+            SampleRecord *wrap = (SampleRecord *)&( sampleRing[ offset ] );
+            wrap->kind = RING_WRAP_RECORD;
+            }
+        // else the worker knows there's no room for a header
+        start += skip;
+        offset = 0;
+        }
+    
+    SampleRecord *record = (SampleRecord *)&( sampleRing[ offset ] );
+    record->kind = inKind;
+    record->threadID = inThreadID;
+    record->nameSize = nameSize;
+    record->dataSize = inDataSize;
+    record->captureAllocations = 0;
+    record->sampleTime = sampleStartTime;
+    
+    char *name = (char *)&( record[1] );
+    strcpy( name, inThreadName );
+    
+    ringRecordStart = start;
+    ringRecordEnd = start + recordSize;
+    
+    return &( name[ nameSize ] );
+    }
+
+
+
+static void commitRingRecord() {
+    ringWritten.store( ringRecordEnd, std::memory_order_release );
+    }
+
+
+
+// stacks the sampling thread couldn't put in the ring, because the 
+// ring was full, or they were too big to be worth holding it up for, 
+// which can only happen with a very large --max-depth
+// counted by the sampling thread, and read by the worker for snapshots
+std::atomic<int> numRingDroppedStacks( 0 );
+
+
+// starts a stack record in the ring, or returns NULL, and counts the 
+// stack, if it's too big or the ring is full
+// the target is stopped while its stacks are captured, so this never 
+// waits for the worker, which can be busy writing a report
+static void *beginStackRecord( int inKind, int inThreadID, 
+                               const char *inThreadName, int inDataSize ) {
+    if( inDataSize > SAMPLE_RING_SIZE / 4 ) {
+        numRingDroppedStacks++;
+        return NULL;
+        }
+    
+    void *data = beginRingRecord( inKind, inThreadID, inThreadName, 
+                                  inDataSize, false );
+    if( data == NULL ) {
+        numRingDroppedStacks++;
+        }
+    return data;
+    }
+
+
+
+// bumped whenever a sample adds something to stackLog or threadLog, 
+// rather than just counting something already there
+// only touched by the worker
+int numLogAdditions = 0;
+
+// stacks cut off at maxStackDepth, and results that held no stack
+// only touched by the worker
+int numTruncatedStacks = 0;
+int numDroppedStacks = 0;
+
+
+// operator new calls made during samples, on either thread, and during 
+// the samples that didn't add anything, which should make none
+long numSampleAllocations = 0;
+long numSteadySampleAllocations = 0;
+int numSteadySamples = 0;
+
+// the sampling thread's count when the sample it's taking began
+long sampleStartAllocations;
+
+
+
+static void beginSample() {
+    samplePauseTime = 0;
+    sampleStartTime = lrint( getMicroseconds() );
+    sampleStartAllocations = numHeapAllocations;
+    }
+
+
+
+// hands the sample to the worker
+static void endSample() {
+    long captureAllocations = numHeapAllocations - sampleStartAllocations;
+    
+    // the target is running again, so this can wait
+    beginRingRecord( SAMPLE_END_RECORD, -1, "", 0, true );
+    
+    SampleRecord *record = 
+        (SampleRecord *)&( sampleRing[ ringRecordStart % SAMPLE_RING_SIZE ] );
+    record->captureAllocations = captureAllocations;
+    record->pauseTime = lrint( samplePauseTime );
+    
+    commitRingRecord();
+    sem_post( &ringSamplesReady );
+    
+    if( samplePauseTime > 0 ) {
+        adjustSampleInterval( samplePauseTime );
+        }
+    }
+
+
+
+
+
+// every function and file name is kept once, in one pool, and frames
+// refer to them by ID
+// ID 0 is the empty string, interned first thing in main
+
+// all of the strings, each \0-terminated
+SimpleVector<char> stringPool;
+
+// indexed by ID
+SimpleVector<unsigned int> stringOffsets;
+SimpleVector<unsigned int> stringHashes;
+
+// open addressing, slots hold IDs, -1 if empty
+int *stringSlots = NULL;
+int numStringSlots = 0;
+
+
+
+static unsigned int hashString( const char *inString ) {
+    unsigned int hash = 2166136261U;
+    
+    for( const char *c = inString; *c != '\0'; c++ ) {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619U;
+        }
+    return hash;
+    }
+
+
+
+// only good until the next string is interned, which can move the pool
+static const char *getString( unsigned int inID ) {
+    return stringPool.getElementFast( stringOffsets.getElementDirect( inID ) );
+    }
+
+
+
+static void insertStringSlot( unsigned int inID ) {
+    int mask = numStringSlots - 1;
+    int slot = stringHashes.getElementDirect( inID ) & mask;
+    
+    while( stringSlots[ slot ] != -1 ) {
+        slot = ( slot + 1 ) & mask;
+        }
+    stringSlots[ slot ] = inID;
+    }
+
+
+
+// returns the ID of inString, adding it to the pool if it's new
+static unsigned int internString( const char *inString ) {
+    unsigned int hash = hashString( inString );
+    
+    if( numStringSlots > 0 ) {
+        int mask = numStringSlots - 1;
+        
+        for( int slot = hash & mask; 
+             stringSlots[ slot ] != -1; 
+             slot = ( slot + 1 ) & mask ) {
+            
+            unsigned int id = stringSlots[ slot ];
+            
+            if( stringHashes.getElementDirect( id ) == hash &&
+                strcmp( getString( id ), inString ) == 0 ) {
+                return id;
+                }
+            }
+        }
+    
+    unsigned int id = stringOffsets.size();
+    
+    stringOffsets.push_back( stringPool.size() );
+    stringHashes.push_back( hash );
+    stringPool.appendArray( (char *)inString, strlen( inString ) + 1 );
+    
+    int numStrings = stringOffsets.size();
+    
+    if( numStrings * 2 > numStringSlots ) {
+        // keep it at most half full
+        if( stringSlots != NULL ) {
+            delete [] stringSlots;
+            }
+        numStringSlots = 256;
+        while( numStrings * 2 > numStringSlots ) {
+            numStringSlots *= 2;
+            }
+        stringSlots = new int[ numStringSlots ];
+        memset( stringSlots, -1, numStringSlots * sizeof( int ) );
+        
+        for( int i=0; i<numStrings - 1; i++ ) {
+            insertStringSlot( i );
+            }
+        }
+    insertStringSlot( id );
+    
+    return id;
+    }
+
+
+
+static void freeStrings() {
+    if( stringSlots != NULL ) {
+        delete [] stringSlots;
+        stringSlots = NULL;
+        }
+    numStringSlots = 0;
+    stringPool.deleteAll();
+    stringOffsets.deleteAll();
+    stringHashes.deleteAll();
+    }
+
+
+
+// where each source file named in a frame can be read from, as the 
+// string ID of its path, by the string ID of its name
+// 0 if nobody told us, and the name alone is all we have
+SimpleVector<unsigned int> sourcePathIDs;
+
+
+
+static char hasSourcePath( unsigned int inFileNameID ) {
+    return (int)inFileNameID < sourcePathIDs.size() &&
+        sourcePathIDs.getElementDirect( inFileNameID ) != 0;
+    }
+
+
+
+// the first path given for a name sticks
+static void setSourcePath( unsigned int inFileNameID, const char *inPath ) {
+    if( hasSourcePath( inFileNameID ) ) {
+        return;
+        }
+    
+    unsigned int pathID = internString( inPath );
+    
+    while( sourcePathIDs.size() <= (int)inFileNameID ) {
+        sourcePathIDs.push_back( 0 );
+        }
+    *( sourcePathIDs.getElementFast( inFileNameID ) ) = pathID;
+    }
+
+
+
+typedef struct StackFrame{
+        void *address;
+        // in the string pool
+        unsigned int funcNameID;
+        unsigned int fileNameID;
+        int lineNum;
+        // true if address is a return address rather than the exact
+        // instruction the frame was stopped at
+        char isCaller;
+    } StackFrame;
+
+
+typedef struct Stack {
+        // innermost first
+        // in the ring or workerArena while a sample is being logged, and
+        // copied to stackArena if it's new
+        StackFrame *frames;
+        int numFrames;
+        int sampleCount;
+        // of the frame addresses, set for stacks in a StackIndex
+        unsigned int hash;
+        // the node for its innermost frame in callTree, for stacks in 
+        // stackLog
+        int callNode;
+    } Stack;
+
+
+// the name of the frame that stands for everything past maxStackDepth
+// interned before sampling starts, so either thread can use it
+unsigned int truncatedFrameNameID;
+
+
+// the outermost frame of a stack cut off at maxStackDepth
+static void setTruncatedFrame( StackFrame *outFrame ) {
+    outFrame->address = NULL;
+    outFrame->funcNameID = truncatedFrameNameID;
+    outFrame->fileNameID = 0;
+    outFrame->lineNum = -1;
+    outFrame->isCaller = true;
+    }
+
+
+
+typedef struct FunctionRecord {
+        unsigned int funcNameID;
+        // samples with this function anywhere on the stack
+        int sampleCount;
+        // samples with this function at the top of the stack
+        int selfCount;
+        // index in stackLog of the last stack counted, so a recursive
+        // function counts once per stack
+        int lastStack;
+        // its place in the order functions were first seen in, which
+        // breaks ties when sorting
+        int firstSeen;
+    } FunctionRecord;
+    
+    
+
+
+SimpleVector<Stack> stackLog;
+
+
+
+// a hash table over a SimpleVector<Stack>, so a sample finds its match
+// without comparing against every unique stack we've seen
+// open addressing, slots hold indices into the vector, -1 if empty
+typedef struct StackIndex {
+        int *slots;
+        // always a power of two
+        int numSlots;
+    } StackIndex;
+
+
+StackIndex stackLogIndex = { NULL, 0 };
+
+
+
+#define STACK_HASH_SEED 0xcbf29ce484222325ULL
+
+static uint64_t addFrameToHash( uint64_t inHash, void *inAddress ) {
+    inHash ^= (uint64_t)inAddress;
+    inHash *= 0x100000001b3ULL;
+    // fold high bits down, since addresses differ mostly in the middle
+    return inHash ^ ( inHash >> 29 );
+    }
+
+
+
+static unsigned int finishStackHash( uint64_t inHash ) {
+    return (unsigned int)( inHash ^ ( inHash >> 32 ) );
+    }
+
+
+
+static char sameFrames( Stack *inA, Stack *inB ) {
+    if( inA->numFrames != inB->numFrames ) {
+        return false;
+        }
+    for( int i=0; i<inA->numFrames; i++ ) {
+        if( inA->frames[i].address != inB->frames[i].address ) {
+            return false;
+            }
+        }
+    return true;
+    }
+
+
+
+// finds the stack in inStacks with the same frames as inStack, whose 
+// hash is inHash
+// returns its index in inStacks, or -1
+static int findStack( StackIndex *inIndex, SimpleVector<Stack> *inStacks,
+                      Stack *inStack, unsigned int inHash ) {
+    if( inIndex->numSlots == 0 ) {
+        return -1;
+        }
+    int mask = inIndex->numSlots - 1;
+    
+    for( int slot = inHash & mask; 
+         inIndex->slots[ slot ] != -1; 
+         slot = ( slot + 1 ) & mask ) {
+        
+        int i = inIndex->slots[ slot ];
+        Stack *s = inStacks->getElementFast( i );
+        
+        if( s->hash == inHash && sameFrames( s, inStack ) ) {
+            return i;
+            }
+        }
+    return -1;
+    }
+
+
+
+static void insertStackSlot( StackIndex *ioIndex, unsigned int inHash, 
+                             int inStackIndex ) {
+    int mask = ioIndex->numSlots - 1;
+    int slot = inHash & mask;
+    
+    while( ioIndex->slots[ slot ] != -1 ) {
+        slot = ( slot + 1 ) & mask;
+        }
+    ioIndex->slots[ slot ] = inStackIndex;
+    }
+
+
+
+// adds the last stack in inStacks, which must have its hash set
+static void addLastStackToIndex( StackIndex *ioIndex, 
+                                 SimpleVector<Stack> *inStacks ) {
+    int numStacks = inStacks->size();
+    
+    if( numStacks * 2 > ioIndex->numSlots ) {
+        // keep it at most half full, so probe runs stay short
+        if( ioIndex->slots != NULL ) {
+            delete [] ioIndex->slots;
+            }
+        ioIndex->numSlots = 64;
+        while( numStacks * 2 > ioIndex->numSlots ) {
+            ioIndex->numSlots *= 2;
+            }
+        ioIndex->slots = new int[ ioIndex->numSlots ];
+        memset( ioIndex->slots, -1, ioIndex->numSlots * sizeof( int ) );
+        
+        for( int i=0; i<numStacks - 1; i++ ) {
+            insertStackSlot( ioIndex, inStacks->getElementFast( i )->hash, 
+                             i );
+            }
+        }
+    
+    insertStackSlot( ioIndex, inStacks->getElementFast( numStacks - 1 )->hash,
+                     numStacks - 1 );
+    }
+
+
+
+static void freeStackIndex( StackIndex *ioIndex ) {
+    if( ioIndex->slots != NULL ) {
+        delete [] ioIndex->slots;
+        }
+    ioIndex->slots = NULL;
+    ioIndex->numSlots = 0;
+    }
+
+
+
+// the calling-context tree:  one node for each distinct path from an
+// outermost frame inward, counting every sample whose stack passes 
+// through it
+// so each node holds the inclusive count of one partial stack, at any 
+// depth, and a sample only adds one to each node on its own path
+typedef struct CallNode {
+        // copied from the stack in stackLog that first reached this node
+        StackFrame frame;
+        // index in callTree, -1 for an outermost frame
+        int parent;
+        // 1 for an outermost frame
+        int depth;
+        int sampleCount;
+    } CallNode;
+
+
+SimpleVector<CallNode> callTree;
+
+// finds a node by its parent and frame, same scheme as StackIndex
+int *callTreeSlots = NULL;
+int numCallTreeSlots = 0;
+
+
+
+static unsigned int hashCallNode( int inParent, StackFrame *inFrame ) {
+    uint64_t hash = addFrameToHash( STACK_HASH_SEED, 
+                                    (void *)(long)inParent );
+    hash = addFrameToHash( hash, inFrame->address );
+    
+    return finishStackHash( hash ) ^ inFrame->isCaller;
+    }
+
+
+
+static void insertCallNodeSlot( int inNodeIndex ) {
+    CallNode *n = callTree.getElementFast( inNodeIndex );
+    
+    int mask = numCallTreeSlots - 1;
+    int slot = hashCallNode( n->parent, &( n->frame ) ) & mask;
+    
+    while( callTreeSlots[ slot ] != -1 ) {
+        slot = ( slot + 1 ) & mask;
+        }
+    callTreeSlots[ slot ] = inNodeIndex;
+    }
+
+
+
+// returns the index of the child of inParent for inFrame, adding it if
+// it's new
+static int getCallNode( int inParent, StackFrame *inFrame ) {
+    if( numCallTreeSlots > 0 ) {
+        int mask = numCallTreeSlots - 1;
+        
+        for( int slot = hashCallNode( inParent, inFrame ) & mask;
+             callTreeSlots[ slot ] != -1;
+             slot = ( slot + 1 ) & mask ) {
+            
+            CallNode *n = callTree.getElementFast( callTreeSlots[ slot ] );
+            
+            if( n->parent == inParent && 
+                n->frame.address == inFrame->address &&
+                n->frame.isCaller == inFrame->isCaller ) {
+                return callTreeSlots[ slot ];
+                }
+            }
+        }
+    
+    CallNode newNode;
+    newNode.frame = *inFrame;
+    newNode.parent = inParent;
+    newNode.depth = 1;
+    newNode.sampleCount = 0;
+    
+    if( inParent != -1 ) {
+        newNode.depth = callTree.getElementFast( inParent )->depth + 1;
+        }
+    
+    callTree.push_back( newNode );
+    
+    int numNodes = callTree.size();
+    
+    if( numNodes * 2 > numCallTreeSlots ) {
+        if( callTreeSlots != NULL ) {
+            delete [] callTreeSlots;
+            }
+        numCallTreeSlots = 64;
+        while( numNodes * 2 > numCallTreeSlots ) {
+            numCallTreeSlots *= 2;
+            }
+        callTreeSlots = new int[ numCallTreeSlots ];
+        memset( callTreeSlots, -1, numCallTreeSlots * sizeof( int ) );
+        
+        for( int i=0; i<numNodes - 1; i++ ) {
+            insertCallNodeSlot( i );
+            }
+        }
+    insertCallNodeSlot( numNodes - 1 );
+    
+    return numNodes - 1;
+    }
+
+
+
+// adds inStack's path to callTree without counting it
+// returns the node of its innermost frame, or -1 if it has no frames
+static int addCallPath( Stack *inStack ) {
+    int node = -1;
+    
+    for( int i=inStack->numFrames - 1; i>=0; i-- ) {
+        node = getCallNode( node, &( inStack->frames[i] ) );
+        }
+    return node;
+    }
+
+
+
+static void countCallPath( int inNode ) {
+    while( inNode != -1 ) {
+        CallNode *n = callTree.getElementFast( inNode );
+        n->sampleCount++;
+        inNode = n->parent;
+        }
+    }
+
+
+
+static void freeCallTree() {
+    if( callTreeSlots != NULL ) {
+        delete [] callTreeSlots;
+        callTreeSlots = NULL;
+        }
+    numCallTreeSlots = 0;
+    callTree.deleteAll();
+    }
+
+
+    
+
+// **************************************
+// GDB/MI records
+
+// a record is a class like ^done followed by name=value results, where
+// each value is a "c-string", a {tuple} of results, or a [list] of
+// values or results
+// everything here works in place on the read buffer:  values are 
+// skipped over without copying them, and strings are unescaped where
+// they sit, so parsing a frame allocates nothing
+
+
+
+typedef struct MIResult {
+        // not terminated, NULL for a bare value in a list
+        const char *name;
+        int nameLength;
+        // first character is ", { or [
+        char *value;
+    } MIResult;
+
+
+
+// returns the first character after the value at inValue, or NULL if 
+// the value is malformed or cut off
+static char *skipMIValue( char *inValue ) {
+    char *pos = inValue;
+    int depth = 0;
+    
+    do {
+        switch( *pos ) {
+            case '"':
+                pos++;
+                while( *pos != '"' ) {
+                    if( *pos == '\0' ) {
+                        return NULL;
+                        }
+                    if( *pos == '\\' && pos[1] != '\0' ) {
+                        pos++;
+                        }
+                    pos++;
+                    }
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                break;
+            case '\0':
+                return NULL;
+            }
+        pos++;
+        } while( depth > 0 );
+    
+    return pos;
+    }
+
+
+
+// reads the next result from the inside of a tuple or list, or from
+// the results that follow a record's class
+// *ioPos is left after it
+// returns false at the closing bracket, or at the end of the record
+static char nextMIResult( char **ioPos, MIResult *outResult ) {
+    char *pos = *ioPos;
+    
+    if( *pos == ',' ) {
+        pos++;
+        }
+    if( *pos == '\0' || *pos == '}' || *pos == ']' ) {
+        return false;
+        }
+    
+    outResult->name = NULL;
+    outResult->nameLength = 0;
+    
+    if( *pos != '"' && *pos != '{' && *pos != '[' ) {
+        char *equals = strchr( pos, '=' );
+        
+        if( equals == NULL ) {
+            return false;
+            }
+        outResult->name = pos;
+        outResult->nameLength = equals - pos;
+        pos = &( equals[1] );
+        }
+    
+    outResult->value = pos;
+    
+    char *end = skipMIValue( pos );
+    
+    if( end == NULL ) {
+        return false;
+        }
+    *ioPos = end;
+    return true;
+    }
+
+
+
+static char isMIResultNamed( MIResult *inResult, const char *inName ) {
+    return inResult->name != NULL &&
+        (int)strlen( inName ) == inResult->nameLength &&
+        memcmp( inResult->name, inName, inResult->nameLength ) == 0;
+    }
+
+
+
+// finds the result named inName in the tuple, list or record at inPos
+// returns the start of its value, or NULL
+static char *findMIResult( char *inPos, const char *inName ) {
+    MIResult result;
+    
+    while( nextMIResult( &inPos, &result ) ) {
+        if( isMIResultNamed( &result, inName ) ) {
+            return result.value;
+            }
+        }
+    return NULL;
+    }
+
+
+
+// unescapes the string value at inValue in place, and terminates it
+// only call this after skipping past the value, since it overwrites
+// the closing quote
+// returns the unescaped string
+static char *decodeMIString( char *inValue ) {
+    if( *inValue != '"' ) {
+        // not a string, so pretend it was empty
+        *inValue = '\0';
+        return inValue;
+        }
+    
+    char *read = &( inValue[1] );
+    char *write = read;
+    
+    while( *read != '"' && *read != '\0' ) {
+        if( *read != '\\' ) {
+            *write++ = *read++;
+            continue;
+            }
+        
+        read++;
+        
+        switch( *read ) {
+            case 'n': *write++ = '\n'; read++; break;
+            case 't': *write++ = '\t'; read++; break;
+            case 'r': *write++ = '\r'; read++; break;
+            case 'a': *write++ = '\a'; read++; break;
+            case 'b': *write++ = '\b'; read++; break;
+            case 'f': *write++ = '\f'; read++; break;
+            case 'v': *write++ = '\v'; read++; break;
+            case 'e': *write++ = '\033'; read++; break;
+            case '\0': break;
+            default:
+                if( *read >= '0' && *read <= '7' ) {
+                    // up to three octal digits
+                    int c = 0;
+                    for( int i=0; i<3 && *read >= '0' && *read <= '7'; i++ ) {
+                        c = c * 8 + ( *read - '0' );
+                        read++;
+                        }
+                    *write++ = (char)c;
+                    }
+                else {
+                    // \" and \\ and anything else stand for themselves
+                    *write++ = *read++;
+                    }
+                break;
+            }
+        }
+    *write = '\0';
+    
+    return &( inValue[1] );
+    }
+
+
+
+static struct MemoryRegion *findCodeRegion( unsigned long inPC );
+
+
+// frames parsed by the worker go in workerArena as they're found, 
+// growing ioStack->frames by doubling into fresh arena space
+static void addSampleFrame( Stack *ioStack, int *ioMaxFrames, 
+                            StackFrame *inFrame ) {
+    if( ioStack->numFrames == *ioMaxFrames ) {
+        int maxFrames = *ioMaxFrames == 0 ? 32 : *ioMaxFrames * 2;
+        
+        StackFrame *frames = (StackFrame *)arenaAlloc( 
+            &workerArena, maxFrames * sizeof( StackFrame ) );
+        
+        if( ioStack->numFrames > 0 ) {
+            memcpy( frames, ioStack->frames, 
+                    ioStack->numFrames * sizeof( StackFrame ) );
+            }
+        ioStack->frames = frames;
+        *ioMaxFrames = maxFrames;
+        }
+    
+    ioStack->frames[ ioStack->numFrames ] = *inFrame;
+    ioStack->numFrames++;
+    }
+
+
+
+// reads the frames of a -stack-list-frames stack=[...] list
+// names are unescaped in the buffer and then interned, which only 
+// copies them the first time they're seen
+// with inAddressesOnly, names are left empty for resolveDeferredSymbols
+static void parseGDBFrames( char *inStackList, Stack *ioStack, 
+                            char inAddressesOnly ) {
+    int maxFrames = 0;
+    
+    char *pos = &( inStackList[1] );
+    MIResult frame;
+    
+    while( nextMIResult( &pos, &frame ) ) {
+        if( frame.value[0] != '{' ) {
+            continue;
+            }
+        
+        StackFrame f;
+        f.address = NULL;
+        f.funcNameID = 0;
+        f.fileNameID = 0;
+        f.lineNum = -1;
+        f.isCaller = ( ioStack->numFrames > 0 );
+        
+        char *fieldPos = &( frame.value[1] );
+        MIResult field;
+        
+        while( nextMIResult( &fieldPos, &field ) ) {
+            if( isMIResultNamed( &field, "addr" ) ) {
+                f.address = (void *)strtoul( &( field.value[1] ), NULL, 16 );
+                }
+            else if( inAddressesOnly ) {
+                continue;
+                }
+            else if( isMIResultNamed( &field, "func" ) ) {
+                f.funcNameID = internString( decodeMIString( field.value ) );
+                }
+            else if( isMIResultNamed( &field, "file" ) ) {
+                f.fileNameID = internString( decodeMIString( field.value ) );
+                }
+            else if( isMIResultNamed( &field, "fullname" ) ) {
+                // GDB found the file, so we can read it ourselves
+                if( f.fileNameID != 0 && ! hasSourcePath( f.fileNameID ) ) {
+                    setSourcePath( f.fileNameID, 
+                                   decodeMIString( field.value ) );
+                    }
+                }
+            else if( isMIResultNamed( &field, "line" ) ) {
+                f.lineNum = atoi( &( field.value[1] ) );
+                }
+            }
+        
+        if( inAddressesOnly ) {
+            // keeps the memory map snapshot current if new code 
+            // was loaded
+            findCodeRegion( (unsigned long)f.address );
+            }
+        
+        addSampleFrame( ioStack, &maxFrames, &f );
+        }
+    }
+
+
+
+static Stack logStack( Stack thisStack, int *outIndex );
+
+static void logThreadStack( int inThreadID, const char *inThreadName,
+                            Stack inStack );
+
+
+// copies one -stack-list-frames result into the ring for the worker
+static void captureGDBStack( char *inResult, int inThreadID, 
+                             const char *inThreadName ) {
+    int size = strlen( inResult ) + 1;
+    
+    char *data = (char *)beginStackRecord( GDB_STACK_RECORD, inThreadID,
+                                           inThreadName, size );
+    if( data == NULL ) {
+        return;
+        }
+    memcpy( data, inResult, size );
+    
+    commitRingRecord();
+    }
+
+
+
+// parses one -stack-list-frames result and logs it for a thread
+static void logGDBStack( char *inResponse, int inThreadID, 
+                         const char *inThreadName ) {
+    char *results = strchr( inResponse, ',' );
+    
+    if( results == NULL ) {
+        numDroppedStacks++;
+        return;
+        }
+    
+    char *stackList = findMIResult( results, "stack" );
+    
+    if( stackList == NULL || stackList[0] != '[' ) {
+        numDroppedStacks++;
+        return;
+        }
+    
+    Stack thisStack;
+    thisStack.frames = NULL;
+    thisStack.numFrames = 0;
+    thisStack.sampleCount = 1;
+    thisStack.hash = 0;
+    thisStack.callNode = -1;
+    
+    parseGDBFrames( stackList, &thisStack, deferSymbols );
+    
+    if( thisStack.numFrames == 0 ) {
+        numDroppedStacks++;
+        return;
+        }
+    
+    if( thisStack.numFrames > maxStackDepth ) {
+        // we ask for one frame past the limit, to know there were more
+        thisStack.numFrames = maxStackDepth;
+        setTruncatedFrame( &( thisStack.frames[ maxStackDepth ] ) );
+        thisStack.numFrames++;
+        
+        numTruncatedStacks++;
+        }
+    
+    logThreadStack( inThreadID, inThreadName, thisStack );
+    }
+
+
+
+// reads GDB output a line at a time, passing each line to inHandler 
+// until it returns true
+static void readGDBLines( char (*inHandler)( char *inLine, void *inContext ),
+                          void *inContext ) {
+    int readSoFar = numPendingGDBBytes;
+    numPendingGDBBytes = 0;
+    
+    anythingInReadBuff = ( readSoFar > 0 );
+    
+    if( readBuff == NULL ) {
+        growReadBuff( 0 );
+        }
+    
+    // the bytes before this hold no newline, they were searched already
+    int searchedTo = 0;
+    
+    while( true ) {
+        readBuff[ readSoFar ] = '\0';
+        
+        char *newText = &( readBuff[ searchedTo ] );
+        char *end = &( readBuff[ readSoFar ] );
+        
+        char *lineStart = readBuff;
+        char *newline;
+        
+        while( ( newline = (char *)memchr( newText, '\n', 
+                                           end - newText ) ) != NULL ) {
+            newline[0] = '\0';
+            newText = &( newline[1] );
+            
+            char done = false;
+            
+            if( lineStart[0] == '=' && ! detatchJustSent &&
+                     strstr( lineStart, "thread-group-exited" ) != NULL ) {
+                programExited = true;
+                done = true;
+                }
+            else if( inHandler( lineStart, inContext ) ) {
+                done = true;
+                }
+            
+            if( done ) {
+                // whatever came after this line is for the next reader
+                numPendingGDBBytes = end - newText;
+                memmove( readBuff, newText, numPendingGDBBytes + 1 );
+                return;
+                }
+            lineStart = &( newline[1] );
+            }
+        
+        // keep the partial line for the next read
+        readSoFar = end - lineStart;
+        memmove( readBuff, lineStart, readSoFar + 1 );
+        searchedTo = readSoFar;
+        
+        if( readSoFar >= readBuffSize - 1 ) {
+            // one line fills all of it
+            growReadBuff( readSoFar );
+            }
+        
+        int numRead = 
+            read( inPipe, &( readBuff[readSoFar] ), 
+                  ( readBuffSize - 1 ) - readSoFar );
+        
+        if( numRead == -1 ) {
+            if( !( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+                char *errorString = strerror( errno );
+                printf( "Error in reading from GDB pipe: %s\n", 
+                        errorString );
+                return;
+                }
+            waitForGDBOutput();
+            continue;
+            }
+        if( numRead == 0 ) {
+            // GDB closed its end, so nothing more is coming
+            programExited = true;
+            return;
+            }
+        
+        anythingInReadBuff = true;
+        
+        readSoFar += numRead;
+        }
+    }
+
+
+
+typedef struct GDBResultReader {
+        int firstToken;
+        int numResults;
+        int numSeen;
+        void (*handler)( char *inResult, int inIndex, void *inContext );
+        void *context;
+    } GDBResultReader;
+
+
+
+// reads the MI token that starts a result record line, like the 12 in
+// 12^done, and points outResult at the ^
+// returns -1 if the line isn't a result record or has no token
+static int getGDBResultToken( char *inLine, char **outResult ) {
+    char *pos = inLine;
+    
+    while( pos[0] >= '0' && pos[0] <= '9' ) {
+        pos++;
+        }
+    
+    if( pos == inLine || pos[0] != '^' ) {
+        return -1;
+        }
+    
+    *outResult = pos;
+    return atoi( inLine );
+    }
+
+
+
+static char handleGDBResultLine( char *inLine, void *inContext ) {
+    GDBResultReader *reader = (GDBResultReader *)inContext;
+    
+    char *result;
+    int token = getGDBResultToken( inLine, &result );
+    
+    if( token != -1 ) {
+        log( "readGDBResults sees", inLine );
+        
+        int index = token - reader->firstToken;
+        
+        // anything else answers a command we stopped waiting for
+        if( index >= 0 && index < reader->numResults ) {
+            reader->handler( result, index, reader->context );
+            reader->numSeen++;
+            }
+        }
+    else if( strstr( inLine, "(gdb)" ) == inLine &&
+             reader->numSeen >= reader->numResults ) {
+        return true;
+        }
+    return false;
+    }
+
+
+
+// MI token for the next command we send, so that its result can be told
+// apart from the results of the commands sent with it, and from stale 
+// ones
+int nextGDBToken = 1;
+
+
+
+// reads results for inNumResults commands that were sent together with 
+// consecutive tokens starting at inFirstToken, passing each result 
+// record (^done, ^error, ^running) to inHandler as it arrives, along with
+// the index of the command it answers
+// stops after the prompt that follows the last one, so the next read 
+// starts clean
+static void readGDBResults( int inFirstToken, int inNumResults, 
+                            void (*inHandler)( char *inResult, int inIndex,
+                                               void *inContext ),
+                            void *inContext ) {
+    GDBResultReader reader = 
+        { inFirstToken, inNumResults, 0, inHandler, inContext };
+    
+    readGDBLines( handleGDBResultLine, &reader );
+    }
+
+
+
+// a thread listed by -thread-info
+typedef struct GDBThread {
+        int id;
+        // in the names arena of the list that holds it
+        char *name;
+        // false if GDB reports it stopped, which only happens in
+        // non-stop mode when something other than us stopped it
+        char running;
+    } GDBThread;
+
+
+
+typedef struct GDBThreadList {
+        SimpleVector<GDBThread> threads;
+        Arena names;
+    } GDBThreadList;
+
+
+
+static void clearGDBThreadList( GDBThreadList *inList ) {
+    inList->threads.shrink( 0 );
+    resetArena( &( inList->names ) );
+    }
+
+
+
+// reads the threads from a -thread-info result
+static void parseThreadInfo( char *inResult, GDBThreadList *outList ) {
+    char *results = strchr( inResult, ',' );
+    
+    if( results == NULL ) {
+        return;
+        }
+    
+    char *threadList = findMIResult( results, "threads" );
+    
+    if( threadList == NULL || threadList[0] != '[' ) {
+        return;
+        }
+    
+    char *pos = &( threadList[1] );
+    MIResult thread;
+    
+    while( nextMIResult( &pos, &thread ) ) {
+        if( thread.value[0] != '{' ) {
+            continue;
+            }
+        
+        GDBThread t;
+        t.id = -1;
+        t.running = false;
+        
+        char *name = NULL;
+        char *targetID = NULL;
+        
+        char *fieldPos = &( thread.value[1] );
+        MIResult field;
+        
+        while( nextMIResult( &fieldPos, &field ) ) {
+            if( isMIResultNamed( &field, "id" ) ) {
+                t.id = atoi( &( field.value[1] ) );
+                }
+            else if( isMIResultNamed( &field, "name" ) ) {
+                name = field.value;
+                }
+            else if( isMIResultNamed( &field, "target-id" ) ) {
+                targetID = field.value;
+                }
+            else if( isMIResultNamed( &field, "state" ) ) {
+                t.running = 
+                    ( strncmp( field.value, "\"running\"", 9 ) == 0 );
+                }
+            }
+        
+        if( t.id == -1 ) {
+            continue;
+            }
+        
+        if( name == NULL ) {
+            name = targetID;
+            }
+        
+        if( name != NULL ) {
+            t.name = arenaStringDuplicate( &( outList->names ), 
+                                           decodeMIString( name ) );
+            }
+        else {
+            t.name = arenaStringDuplicate( &( outList->names ), "?" );
+            }
+        
+        outList->threads.push_back( t );
+        }
+    }
+
+
+
+// -thread-info is read on its own, so there's no index to look at
+static void handleThreadInfoResult( char *inResult, int /* inIndex */,
+                                    void *inContext ) {
+    parseThreadInfo( inResult, (GDBThreadList *)inContext );
+    }
+
+
+
+// true if GDB takes commands while the target runs (target-async), so 
+// the thread list for the next sample can be asked for along with 
+// resuming the target from this one
+char gdbIsAsync = false;
+
+
+// two lists, so one can be filled while the other is still being sampled
+// reused from one sample to the next, so they stop growing
+GDBThreadList gdbThreadLists[2];
+int currentGDBThreadList = 0;
+
+// true if the current list was filled after the last sample resumed the 
+// target, and can stand in for listing the threads now
+char gdbThreadListReady = false;
+
+// the commands sent for a sample
+SimpleVector<char> gdbCommands;
+
+
+
+// replaces the contents of outList with GDB's current threads
+static void listGDBThreads( GDBThreadList *outList ) {
+    clearGDBThreadList( outList );
+    
+    int token = nextGDBToken++;
+    
+    char command[32];
+    snprintf( command, sizeof( command ), "%d-thread-info", token );
+    sendCommand( command );
+    
+    readGDBResults( token, 1, handleThreadInfoResult, outList );
+    }
+
+
+
+// appends a command with the next token to gdbCommands
+static void addGDBCommand( const char *inFormat, int inThreadID ) {
+    char command[64];
+    
+    int length = 
+        snprintf( command, sizeof( command ), "%d", nextGDBToken++ );
+    snprintf( &( command[length] ), sizeof( command ) - length, 
+              inFormat, inThreadID );
+    
+    gdbCommands.appendElementString( command );
+    }
+
+
+
+// appends a -stack-list-frames for inThreadID, which lists one frame 
+// past maxStackDepth so a stack that goes deeper can be told apart
+static void addStackListCommand( int inThreadID ) {
+    char command[80];
+    snprintf( command, sizeof( command ), 
+              "%d-stack-list-frames --thread %d 0 %d\n", 
+              nextGDBToken++, inThreadID, maxStackDepth );
+    
+    gdbCommands.appendElementString( command );
+    }
+
+
+
+// sends gdbCommands in one write
+static void sendGDBCommands() {
+    gdbCommands.push_back( '\0' );
+    
+    char *commandString = gdbCommands.getElementFast( 0 );
+    
+    log( "Sending commands to GDB", commandString );
+    write( outPipe, commandString, gdbCommands.size() - 1 );
+    }
+
+
+
+// the stacks asked for in one write, followed by the command that resumes
+// what they stopped
+typedef struct GDBSampleBatch {
+        GDBThread *threads;
+        int numThreads;
+        // index of the result that resumes the target, or -1 if nothing
+        // was resumed
+        int continueIndex;
+        // filled by the result after that, if not NULL
+        GDBThreadList *nextThreads;
+        char gotNextThreads;
+        double pauseStart;
+        int numStacks;
+    } GDBSampleBatch;
+
+
+
+static void handleSampleBatchResult( char *inResult, int inIndex,
+                                     void *inContext ) {
+    GDBSampleBatch *batch = (GDBSampleBatch *)inContext;
+    
+    if( inIndex < batch->numThreads ) {
+        // a thread that exited since it was listed gets an ^error
+        if( strncmp( inResult, "^done", 5 ) == 0 ) {
+            GDBThread *t = &( batch->threads[ inIndex ] );
+            
+            captureGDBStack( inResult, t->id, t->name );
+            batch->numStacks++;
+            }
+        }
+    else if( inIndex == batch->continueIndex ) {
+        // running again, the rest happens on its time
+        if( strncmp( inResult, "^running", 8 ) == 0 ) {
+            logPause( batch->pauseStart );
+            }
+        }
+    else if( batch->nextThreads != NULL &&
+             strncmp( inResult, "^done", 5 ) == 0 ) {
+        parseThreadInfo( inResult, batch->nextThreads );
+        batch->gotNextThreads = true;
+        }
+    }
+
+
+
+// the target must be stopped, since inPauseStart
+// asks for all of its threads' stacks and resumes it in one write, so it 
+// only stays stopped for one round trip to GDB
+// returns the number of stacks logged
+static int sampleGDBThreads( double inPauseStart ) {
+    GDBThreadList *threads = &( gdbThreadLists[ currentGDBThreadList ] );
+    
+    if( ! gdbThreadListReady ) {
+        listGDBThreads( threads );
+        }
+    gdbThreadListReady = false;
+    
+    if( programExited ) {
+        return 0;
+        }
+    
+    GDBSampleBatch batch;
+    batch.threads = NULL;
+    batch.numThreads = threads->threads.size();
+    batch.continueIndex = batch.numThreads;
+    batch.nextThreads = NULL;
+    batch.gotNextThreads = false;
+    batch.pauseStart = inPauseStart;
+    batch.numStacks = 0;
+    
+    if( batch.numThreads > 0 ) {
+        batch.threads = threads->threads.getElementFast( 0 );
+        }
+    
+    int firstToken = nextGDBToken;
+    int numCommands = batch.numThreads + 1;
+    
+    gdbCommands.shrink( 0 );
+    
+    for( int i=0; i<batch.numThreads; i++ ) {
+        addStackListCommand( batch.threads[i].id );
+        }
+    addGDBCommand( "-exec-continue\n", 0 );
+    
+    if( gdbIsAsync ) {
+        // a thread started before the next sample is missed by it, but 
+        // one that exits only costs an ^error
+        batch.nextThreads = 
+            &( gdbThreadLists[ 1 - currentGDBThreadList ] );
+        clearGDBThreadList( batch.nextThreads );
+        
+        addGDBCommand( "-thread-info\n", 0 );
+        numCommands++;
+        }
+    
+    sendGDBCommands();
+    
+    readGDBResults( firstToken, numCommands, 
+                    handleSampleBatchResult, &batch );
+    
+    if( batch.gotNextThreads ) {
+        currentGDBThreadList = 1 - currentGDBThreadList;
+        gdbThreadListReady = true;
+        }
+    
+    return batch.numStacks;
+    }
+
+
+
+typedef struct GDBThreadStopWait {
+        int token;
+        char stopMarker[32];
+        char gotResult;
+        char failed;
+        char stopped;
+    } GDBThreadStopWait;
+
+
+
+static char handleThreadStopLine( char *inLine, void *inContext ) {
+    GDBThreadStopWait *wait = (GDBThreadStopWait *)inContext;
+    
+    char *result;
+    int token = getGDBResultToken( inLine, &result );
+    
+    if( token != -1 ) {
+        log( "waitForGDBThreadStop sees", inLine );
+        
+        if( token == wait->token ) {
+            wait->gotResult = true;
+            wait->failed = ( strstr( result, "^error" ) == result );
+            }
+        }
+    else if( strstr( inLine, "*stopped," ) == inLine ) {
+        log( "waitForGDBThreadStop sees", inLine );
+        
+        if( strstr( inLine, "reason=\"exited" ) != NULL ) {
+            programExited = true;
+            return true;
+            }
+        if( strstr( inLine, wait->stopMarker ) != NULL ) {
+            wait->stopped = true;
+            }
+        }
+    else if( wait->failed && strstr( inLine, "(gdb)" ) == inLine ) {
+        return true;
+        }
+    
+    return wait->gotResult && wait->stopped;
+    }
+
+
+
+// after -exec-interrupt --thread inThreadID, sent with inToken, waits for
+// that thread to report its stop
+// returns false if it couldn't be stopped (it probably just exited)
+static char waitForGDBThreadStop( int inToken, int inThreadID ) {
+    GDBThreadStopWait wait;
+    wait.token = inToken;
+    snprintf( wait.stopMarker, sizeof( wait.stopMarker ),
+              "thread-id=\"%d\"", inThreadID );
+    wait.gotResult = false;
+    wait.failed = false;
+    wait.stopped = false;
+    
+    readGDBLines( handleThreadStopLine, &wait );
+    
+    return wait.stopped && ! programExited;
+    }
+
+
+
+// non-stop mode:  the target keeps running, and each of its threads is
+// interrupted on its own, just long enough to list its stack
+// returns the number of stacks logged
+static int sampleGDBThreadsNonStop() {
+    // nothing is stopped, so there's no pause to save by listing them
+    // ahead of time
+    GDBThreadList *threads = &( gdbThreadLists[0] );
+    
+    listGDBThreads( threads );
+    
+    int numStacks = 0;
+    
+    for( int i=0; i<threads->threads.size() && ! programExited; i++ ) {
+        GDBSampleBatch batch;
+        batch.threads = threads->threads.getElementFast( i );
+        batch.numThreads = 1;
+        batch.continueIndex = -1;
+        batch.nextThreads = NULL;
+        batch.gotNextThreads = false;
+        batch.pauseStart = 0;
+        batch.numStacks = 0;
+        
+        int id = batch.threads->id;
+        int firstToken;
+        
+        gdbCommands.shrink( 0 );
+        
+        if( ! batch.threads->running ) {
+            // stopped by something else, like a signal, so sample it
+            // as it is and leave resuming it to whoever stopped it
+            firstToken = nextGDBToken;
+            addStackListCommand( id );
+            sendGDBCommands();
+            }
+        else {
+            batch.pauseStart = getMicroseconds();
+            
+            int interruptToken = nextGDBToken;
+            addGDBCommand( "-exec-interrupt --thread %d\n", id );
+            sendGDBCommands();
+            
+            if( ! waitForGDBThreadStop( interruptToken, id ) ) {
+                continue;
+                }
+            
+            // resume it in the same write
+            gdbCommands.shrink( 0 );
+            
+            firstToken = nextGDBToken;
+            addStackListCommand( id );
+            addGDBCommand( "-exec-continue --thread %d\n", id );
+            batch.continueIndex = 1;
+            
+            sendGDBCommands();
+            }
+        
+        readGDBResults( firstToken, batch.continueIndex == -1 ? 1 : 2, 
+                        handleSampleBatchResult, &batch );
+        
+        numStacks += batch.numStacks;
+        }
+    
+    return numStacks;
+    }
+
+
+
+// **************************************
+// recording samples to a file
+
+// with --record, every sample is also written to a file, which the 
+// report subcommand turns into the usual report later, maybe elsewhere
+// the file is a magic line and then a stream of records, each a type 
+// byte followed by varints, appended as sampling goes:  strings, frames
+// and stacks the first time they're needed, a thread the first time 
+// it's seen, and one record per thread stack sampled
+// records refer to strings, frames, stacks and threads by the order 
+// they were written in
+// frames are delta-encoded by address, stacks by how many outermost 
+// frames they share with the stack written before them, and samples by 
+// time since the sample before them
+
+
+#define RECORDING_MAGIC "wcpRec1\n"
+#define RECORDING_MAGIC_LENGTH 8
+
+
+typedef enum RecordingRecordType {
+    // unix time, length-prefixed program name
+    START_RECORDING = 1,
+    // length-prefixed bytes
+    STRING_RECORDING,
+    // address delta, isCaller, funcNameID, fileNameID, line
+    FRAME_RECORDING,
+    // number of frames, number shared with the last stack, then the 
+    // frame IDs of the rest, outermost first
+    STACK_RECORDING,
+    // thread ID, name string ID
+    THREAD_RECORDING,
+    // microseconds since the last sample, thread, stack
+    SAMPLE_RECORDING,
+    // frame, funcNameID, fileNameID, line, for names found after the 
+    // frame was written
+    FRAME_NAMES_RECORDING,
+    // file name string ID, path string ID
+    SOURCE_PATH_RECORDING,
+    // the summary counts, and the pause histogram
+    SUMMARY_RECORDING
+    } RecordingRecordType;
+
+
+
+FILE *recordingFile = NULL;
+
+// strings are written in string pool order, so a string's ID in the 
+// file is its ID in the pool
+int numRecordedStrings = 0;
+
+// by ID, for matching and for naming them once sampling is done
+SimpleVector<StackFrame> recordedFrames;
+
+// open addressing table of recordedFrames indices, -1 for empty
+int *recordedFrameSlots = NULL;
+int numRecordedFrameSlots = 0;
+
+void *lastRecordedAddress = NULL;
+
+// frame IDs of the last stack written, outermost first
+SimpleVector<int> lastRecordedStack;
+
+int numRecordedThreads = 0;
+
+// when the sample being logged was taken, and the last sample written
+long recordingSampleTime = 0;
+long lastRecordedSampleTime = 0;
+
+
+
+static void writeRecordingVarint( unsigned long inValue ) {
+    while( inValue >= 0x80 ) {
+        putc( (int)( inValue & 0x7F ) | 0x80, recordingFile );
+        inValue >>= 7;
+        }
+    putc( (int)inValue, recordingFile );
+    }
+
+
+
+// small negative numbers stay small
+static void writeRecordingSigned( long inValue ) {
+    writeRecordingVarint( ( (unsigned long)inValue << 1 ) ^ 
+                          (unsigned long)( inValue >> 63 ) );
+    }
+
+
+
+static void writeRecordingBytes( const char *inBytes, int inLength ) {
+    writeRecordingVarint( inLength );
+    fwrite( inBytes, 1, inLength, recordingFile );
+    }
+
+
+
+// writes any strings interned since the last call
+static void writeNewRecordingStrings() {
+    while( numRecordedStrings < stringOffsets.size() ) {
+        const char *s = getString( numRecordedStrings );
+        
+        putc( STRING_RECORDING, recordingFile );
+        writeRecordingBytes( s, strlen( s ) );
+        
+        numRecordedStrings++;
+        }
+    }
+
+
+
+static unsigned int hashRecordedFrame( StackFrame *inFrame ) {
+    uint64_t hash = addFrameToHash( STACK_HASH_SEED, inFrame->address );
+    return finishStackHash( hash ) ^ inFrame->isCaller;
+    }
+
+
+
+static void insertRecordedFrameSlot( int inID ) {
+    int mask = numRecordedFrameSlots - 1;
+    int slot = hashRecordedFrame( recordedFrames.getElementFast( inID ) ) 
+        & mask;
+    
+    while( recordedFrameSlots[ slot ] != -1 ) {
+        slot = ( slot + 1 ) & mask;
+        }
+    recordedFrameSlots[ slot ] = inID;
+    }
+
+
+
+// returns the ID of inFrame, writing it first if it's new
+// frames are the same if their addresses are
+static int getRecordedFrame( StackFrame *inFrame ) {
+    unsigned int hash = hashRecordedFrame( inFrame );
+    
+    if( numRecordedFrameSlots > 0 ) {
+        int mask = numRecordedFrameSlots - 1;
+        
+        for( int slot = hash & mask;
+             recordedFrameSlots[ slot ] != -1;
+             slot = ( slot + 1 ) & mask ) {
+            
+            int id = recordedFrameSlots[ slot ];
+            StackFrame *f = recordedFrames.getElementFast( id );
+            
+            if( f->address == inFrame->address &&
+                f->isCaller == inFrame->isCaller ) {
+                return id;
+                }
+            }
+        }
+    
+    writeNewRecordingStrings();
+    
+    putc( FRAME_RECORDING, recordingFile );
+    writeRecordingSigned( (char *)inFrame->address - 
+                          (char *)lastRecordedAddress );
+    writeRecordingVarint( inFrame->isCaller );
+    writeRecordingVarint( inFrame->funcNameID );
+    writeRecordingVarint( inFrame->fileNameID );
+    writeRecordingSigned( inFrame->lineNum );
+    
+    lastRecordedAddress = inFrame->address;
+    
+    int id = recordedFrames.size();
+    recordedFrames.push_back( *inFrame );
+    
+    if( recordedFrames.size() * 2 > numRecordedFrameSlots ) {
+        // keep it at most half full
+        if( recordedFrameSlots != NULL ) {
+            delete [] recordedFrameSlots;
+            }
+        numRecordedFrameSlots = 
+            numRecordedFrameSlots == 0 ? 1024 : numRecordedFrameSlots * 2;
+        
+        recordedFrameSlots = new int[ numRecordedFrameSlots ];
+        memset( recordedFrameSlots, -1, 
+                numRecordedFrameSlots * sizeof( int ) );
+        
+        for( int i=0; i<recordedFrames.size(); i++ ) {
+            insertRecordedFrameSlot( i );
+            }
+        }
+    else {
+        insertRecordedFrameSlot( id );
+        }
+    
+    return id;
+    }
+
+
+
+// writes a stack that was just added to stackLog, so its ID in the file
+// is its index there
+static void recordStack( Stack *inStack ) {
+    int numFrames = inStack->numFrames;
+    
+    // any new frames go first, since a record can't be interrupted
+    // outermost first, so stacks under the same caller share a prefix
+    int shared = 0;
+    char stillShared = true;
+    
+    for( int i=0; i<numFrames; i++ ) {
+        int id = 
+            getRecordedFrame( &( inStack->frames[ numFrames - 1 - i ] ) );
+        
+        if( stillShared && i < lastRecordedStack.size() &&
+            lastRecordedStack.getElementDirect( i ) == id ) {
+            shared++;
+            continue;
+            }
+        stillShared = false;
+        
+        if( i < lastRecordedStack.size() ) {
+            *( lastRecordedStack.getElementFast( i ) ) = id;
+            }
+        else {
+            lastRecordedStack.push_back( id );
+            }
+        }
+    lastRecordedStack.shrink( numFrames );
+    
+    putc( STACK_RECORDING, recordingFile );
+    writeRecordingVarint( numFrames );
+    writeRecordingVarint( shared );
+    
+    for( int i=shared; i<numFrames; i++ ) {
+        writeRecordingVarint( lastRecordedStack.getElementDirect( i ) );
+        }
+    }
+
+
+
+// returns the ID to record samples of this thread with
+static int recordThread( int inThreadID, const char *inThreadName ) {
+    unsigned int nameID = internString( inThreadName );
+    
+    writeNewRecordingStrings();
+    
+    putc( THREAD_RECORDING, recordingFile );
+    writeRecordingVarint( inThreadID );
+    writeRecordingVarint( nameID );
+    
+    return numRecordedThreads++;
+    }
+
+
+
+static void recordSample( int inRecordedThread, int inStackIndex ) {
+    long delta = recordingSampleTime - lastRecordedSampleTime;
+    if( delta < 0 ) {
+        delta = 0;
+        }
+    lastRecordedSampleTime = recordingSampleTime;
+    
+    putc( SAMPLE_RECORDING, recordingFile );
+    writeRecordingVarint( delta );
+    writeRecordingVarint( inRecordedThread );
+    writeRecordingVarint( inStackIndex );
+    }
+
+
+
+// returns false if inPath can't be written
+static char startRecording( const char *inPath, const char *inProgName ) {
+    recordingFile = fopen( inPath, "wb" );
+    
+    if( recordingFile == NULL ) {
+        return false;
+        }
+    
+    fwrite( RECORDING_MAGIC, 1, RECORDING_MAGIC_LENGTH, recordingFile );
+    
+    putc( START_RECORDING, recordingFile );
+    writeRecordingVarint( time( NULL ) );
+    writeRecordingBytes( inProgName, strlen( inProgName ) );
+    
+    // samples are timed from here
+    lastRecordedSampleTime = lrint( getMicroseconds() );
+    
+    return true;
+    }
+
+
+
+// returns the matching stack in stackLog, and its index there in 
+// outIndex
+static Stack logStack( Stack thisStack, int *outIndex ) {
+    int numFrames = thisStack.numFrames;
+    
+    uint64_t hash = STACK_HASH_SEED;
+    
+    for( int i=0; i<numFrames; i++ ) {
+        hash = addFrameToHash( hash, thisStack.frames[i].address );
+        }
+    thisStack.hash = finishStackHash( hash );
+    
+    Stack insertedStack;
+    
+    int match = findStack( &stackLogIndex, &stackLog, &thisStack, 
+                           thisStack.hash );
+    
+    if( match != -1 ) {
+        Stack *inOld = stackLog.getElementFast( match );
+        inOld->sampleCount++;
+        insertedStack = *inOld;
+        *outIndex = match;
+        }
+    else {
+        // out of the ring or workerArena, to live as long as stackLog
+        StackFrame *frames = (StackFrame *)arenaAlloc( 
+            &stackArena, numFrames * sizeof( StackFrame ) );
+        memcpy( frames, thisStack.frames, numFrames * sizeof( StackFrame ) );
+        thisStack.frames = frames;
+        
+        thisStack.callNode = addCallPath( &thisStack );
+        
+        stackLog.push_back( thisStack );
+        addLastStackToIndex( &stackLogIndex, &stackLog );
+        
+        *outIndex = stackLog.size() - 1;
+        
+        if( recordingFile != NULL ) {
+            recordStack( &thisStack );
+            }
+        
+        insertedStack = thisStack;
+        numLogAdditions++;
+        }
+    
+    countCallPath( insertedStack.callNode );
+    
+    return insertedStack;
+    }
+
+
+
+// samples broken down by thread name, so a pool of identical workers
+// shows up as one entry
+typedef struct ThreadRecord {
+        char *name;
+        // IDs of the threads we've seen with this name
+        SimpleVector<int> threadIDs;
+        // what each of them was written to a recording as
+        SimpleVector<int> recordedThreads;
+        int sampleCount;
+        // copies of stacks in stackLog, sharing their frames, with this 
+        // thread's own sample counts
+        SimpleVector<Stack> stacks;
+        StackIndex stackIndex;
+    } ThreadRecord;
+
+
+SimpleVector<ThreadRecord> threadLog;
+
+
+// the threadLog index for each interned thread name, or -1 for names 
+// that aren't threads
+SimpleVector<int> threadRecordIndices;
+
+
+// a thread ID we've seen under a name, and where it was logged
+typedef struct ThreadEntry {
+        int threadID;
+        unsigned int nameID;
+        int recordIndex;
+        // in the record's threadIDs
+        int idIndex;
+    } ThreadEntry;
+
+SimpleVector<ThreadEntry> threadEntries;
+
+// open addressing by thread ID, slots hold threadEntries indices, -1 if 
+// empty
+int *threadEntrySlots = NULL;
+int numThreadEntrySlots = 0;
+
+
+
+static unsigned int hashThreadID( int inThreadID ) {
+    return (unsigned int)inThreadID * 2654435761U;
+    }
+
+
+
+static void insertThreadEntrySlot( int inIndex ) {
+    int mask = numThreadEntrySlots - 1;
+    int slot = hashThreadID( threadEntries.getElementFast( inIndex )->
+                             threadID ) & mask;
+    
+    while( threadEntrySlots[ slot ] != -1 ) {
+        slot = ( slot + 1 ) & mask;
+        }
+    threadEntrySlots[ slot ] = inIndex;
+    }
+
+
+
+// returns the entry for inThreadID under inThreadName, adding it, and 
+// the name's record, if they're new
+// a thread that renames itself gets a second entry, under its new name
+static ThreadEntry *getThreadEntry( int inThreadID, 
+                                    const char *inThreadName ) {
+    unsigned int nameID = internString( inThreadName );
+    
+    if( numThreadEntrySlots > 0 ) {
+        int mask = numThreadEntrySlots - 1;
+        
+        for( int slot = hashThreadID( inThreadID ) & mask;
+             threadEntrySlots[ slot ] != -1;
+             slot = ( slot + 1 ) & mask ) {
+            
+            ThreadEntry *e = 
+                threadEntries.getElementFast( threadEntrySlots[ slot ] );
+            
+            if( e->threadID == inThreadID && e->nameID == nameID ) {
+                return e;
+                }
+            }
+        }
+    
+    while( threadRecordIndices.size() <= (int)nameID ) {
+        threadRecordIndices.push_back( -1 );
+        }
+    
+    int recordIndex = threadRecordIndices.getElementDirect( nameID );
+    
+    if( recordIndex == -1 ) {
+        // its vectors are constructed where they'll stay
+        ThreadRecord *record = threadLog.emplace_back();
+        record->name = stringDuplicate( inThreadName );
+        record->sampleCount = 0;
+        record->stackIndex.slots = NULL;
+        record->stackIndex.numSlots = 0;
+        numLogAdditions++;
+        
+        recordIndex = threadLog.size() - 1;
+        *( threadRecordIndices.getElementFast( nameID ) ) = recordIndex;
+        }
+    
+    ThreadRecord *record = threadLog.getElementFast( recordIndex );
+    
+    // the same ID can come back under a name it had before
+    int idIndex = record->threadIDs.getElementIndex( inThreadID );
+    
+    if( idIndex == -1 ) {
+        idIndex = record->threadIDs.size();
+        record->threadIDs.push_back( inThreadID );
+        
+        if( recordingFile != NULL ) {
+            record->recordedThreads.push_back( 
+                recordThread( inThreadID, inThreadName ) );
+            }
+        }
+    
+    ThreadEntry newEntry = { inThreadID, nameID, recordIndex, idIndex };
+    threadEntries.push_back( newEntry );
+    numLogAdditions++;
+    
+    if( threadEntries.size() * 2 > numThreadEntrySlots ) {
+        // keep it at most half full
+        if( threadEntrySlots != NULL ) {
+            delete [] threadEntrySlots;
+            }
+        numThreadEntrySlots = 
+            numThreadEntrySlots == 0 ? 64 : numThreadEntrySlots * 2;
+        
+        threadEntrySlots = new int[ numThreadEntrySlots ];
+        memset( threadEntrySlots, -1, numThreadEntrySlots * sizeof( int ) );
+        
+        for( int i=0; i<threadEntries.size(); i++ ) {
+            insertThreadEntrySlot( i );
+            }
+        }
+    else {
+        insertThreadEntrySlot( threadEntries.size() - 1 );
+        }
+    
+    return threadEntries.getElementFast( threadEntries.size() - 1 );
+    }
+
+
+
+// logs inStack for the whole process and for its thread
+static void logThreadStack( int inThreadID, const char *inThreadName,
+                            Stack inStack ) {
+    int stackIndex;
+    Stack logged = logStack( inStack, &stackIndex );
+    
+    ThreadEntry *entry = getThreadEntry( inThreadID, inThreadName );
+    
+    ThreadRecord *record = threadLog.getElementFast( entry->recordIndex );
+    int idIndex = entry->idIndex;
+    
+    record->sampleCount++;
+    
+    if( recordingFile != NULL ) {
+        recordSample( record->recordedThreads.getElementDirect( idIndex ),
+                      stackIndex );
+        }
+    
+    int match = findStack( &( record->stackIndex ), &( record->stacks ),
+                           &logged, logged.hash );
+    
+    if( match != -1 ) {
+        record->stacks.getElementFast( match )->sampleCount++;
+        return;
+        }
+    
+    logged.sampleCount = 1;
+    record->stacks.push_back( logged );
+    addLastStackToIndex( &( record->stackIndex ), &( record->stacks ) );
+    numLogAdditions++;
+    }
+
+
+
+// the worker's counts when the sample it's logging began
+long workerStartAllocations;
+int workerStartAdditions;
+
+// samples the worker has finished logging
+int numWorkerSamples = 0;
+
+// how long those samples paused the target, in microseconds
+double workerPauseTime = 0;
+
+// when the next snapshot is due, on the getMicroseconds clock
+double nextSnapshotTime = -1;
+
+// when the live view should next be redrawn, or -1 if it's not shown
+double nextLiveViewTime = -1;
+
+// microseconds between redraws
+#define LIVE_VIEW_INTERVAL 250000
+
+
+static void writeSnapshot( double inSampleTime );
+
+static void drawLiveView( double inSampleTime );
+
+static void checkWindow( double inSampleTime );
+
+static void loadMappedDebugInfo();
+
+// set when the worker needs debug info mid-run, for the live view,
+// snapshots or windows, so it loads it for new libraries between samples
+char preloadDebugInfo = false;
+
+
+
+static void finishWorkerSample( SampleRecord *inEnd ) {
+    // before counting, like endSample
+    resetArena( &workerArena );
+    
+    long allocations = inEnd->captureAllocations + 
+        numHeapAllocations - workerStartAllocations;
+    
+    numSampleAllocations += allocations;
+    
+    if( numLogAdditions == workerStartAdditions ) {
+        numSteadySamples++;
+        numSteadySampleAllocations += allocations;
+        }
+    
+    workerStartAllocations = numHeapAllocations;
+    workerStartAdditions = numLogAdditions;
+    
+    numWorkerSamples++;
+    workerPauseTime += inEnd->pauseTime;
+    
+    if( preloadDebugInfo ) {
+        loadMappedDebugInfo();
+        }
+    
+    if( nextLiveViewTime >= 0 && inEnd->sampleTime >= nextLiveViewTime ) {
+        drawLiveView( inEnd->sampleTime );
+        nextLiveViewTime = inEnd->sampleTime + LIVE_VIEW_INTERVAL;
+        }
+    
+    checkWindow( inEnd->sampleTime );
+    
+    if( nextSnapshotTime >= 0 && inEnd->sampleTime >= nextSnapshotTime ) {
+        writeSnapshot( inEnd->sampleTime );
+        
+        // one per period, however long this one took
+        while( nextSnapshotTime <= inEnd->sampleTime ) {
+            nextSnapshotTime += snapshotSeconds * 1000000;
+            }
+        }
+    
+    // what the live view and snapshots allocate isn't part of a sample
+    workerStartAllocations = numHeapAllocations;
+    }
+
+
+
+// the worker thread, which owns stackLog, callTree, threadLog and the 
+// string pool until it's stopped
+// logs each sample once endSample has put all of it in the ring
+static void runSampleWorker() {
+    workerStartAllocations = numHeapAllocations;
+    workerStartAdditions = numLogAdditions;
+    
+    char stopped = false;
+    
+    while( ! stopped ) {
+        while( sem_wait( &ringSamplesReady ) == -1 && errno == EINTR ) {
+            }
+        
+        char sampleDone = false;
+        
+        while( ! sampleDone ) {
+            long position = ringRead.load( std::memory_order_relaxed );
+            
+            if( position == ringWritten.load( std::memory_order_acquire ) ) {
+                // can't happen, since we were posted after the end
+                break;
+                }
+            
+            long offset = position % SAMPLE_RING_SIZE;
+            long toEnd = SAMPLE_RING_SIZE - offset;
+            
+            SampleRecord *record = (SampleRecord *)&( sampleRing[ offset ] );
+            
+            if( toEnd < (long)sizeof( SampleRecord ) ||
+                record->kind == RING_WRAP_RECORD ) {
+                ringRead.store( position + toEnd, std::memory_order_release );
+                continue;
+                }
+            
+            char *name = (char *)&( record[1] );
+            char *data = &( name[ record->nameSize ] );
+            
+            recordingSampleTime = record->sampleTime;
+            
+            switch( record->kind ) {
+                case GDB_STACK_RECORD:
+                    logGDBStack( data, record->threadID, name );
+                    break;
+                case NATIVE_STACK_RECORD: {
+                    Stack thisStack;
+                    thisStack.frames = (StackFrame *)data;
+                    thisStack.numFrames = 
+                        record->dataSize / sizeof( StackFrame );
+                    thisStack.sampleCount = 1;
+                    thisStack.hash = 0;
+                    thisStack.callNode = -1;
+                    
+                    if( thisStack.numFrames > 0 &&
+                        thisStack.frames[ thisStack.numFrames - 1 ].address 
+                        == NULL ) {
+                        numTruncatedStacks++;
+                        }
+                    
+                    logThreadStack( record->threadID, name, thisStack );
+                    break;
+                    }
+                case SAMPLE_END_RECORD:
+                    finishWorkerSample( record );
+                    sampleDone = true;
+                    break;
+                case PIPELINE_STOP_RECORD:
+                    sampleDone = true;
+                    stopped = true;
+                    break;
+                }
+            
+            // logStack copied out anything it keeps, so the record's
+            // space can be reused
+            ringRead.store( position + sizeof( SampleRecord ) + 
+                            record->nameSize + 
+                            alignRecordSize( record->dataSize ), 
+                            std::memory_order_release );
+            }
+        }
+    }
+
+
+
+std::thread sampleWorkerThread;
+
+
+
+static void startSamplePipeline() {
+    sampleRing = new char[ SAMPLE_RING_SIZE ];
+    sem_init( &ringSamplesReady, 0, 0 );
+    
+    sampleWorkerThread = std::thread( runSampleWorker );
+    }
+
+
+
+// waits for the worker to log everything in the ring
+static void stopSamplePipeline() {
+    beginRingRecord( PIPELINE_STOP_RECORD, -1, "", 0, true );
+    commitRingRecord();
+    sem_post( &ringSamplesReady );
+    
+    sampleWorkerThread.join();
+    
+    sem_destroy( &ringSamplesReady );
+    delete [] sampleRing;
+    sampleRing = NULL;
+    }
+
+
+
+// **************************************
+// ELF symbol lookup for the native backend
+
+// GDB isn't around to name our frames, so we read function symbols
+// straight out of the ELF files that are mapped into the target
+
+
+#if __ELF_NATIVE_CLASS == 64
+    #define ELF_NATIVE_CLASS ELFCLASS64
+    #define ELF_NATIVE_ST_TYPE( info ) ELF64_ST_TYPE( info )
+#else
+    #define ELF_NATIVE_CLASS ELFCLASS32
+    #define ELF_NATIVE_ST_TYPE( info ) ELF32_ST_TYPE( info )
+#endif
+
+
+typedef struct ElfSymbol {
+        unsigned long address;
+        unsigned long size;
+        // points into the mapped string table
+        const char *name;
+        // demangled on first use, NULL until then
+        char *demangledName;
+    } ElfSymbol;
+
+
+// one row of a .debug_line table, reduced to what we report
+// fixed-size fields so a table can be used straight out of a 
+// mapped cache file
+typedef struct LineEntry {
+        uint64_t address;
+        // index into lineFiles, or -1 for the end of a sequence
+        int32_t fileIndex;
+        int32_t line;
+    } LineEntry;
+
+
+// a source file named in a line table
+typedef struct LineFile {
+        // NULL if the table doesn't say (it's the compilation directory)
+        const char *dir;
+        const char *name;
+    } LineFile;
+
+
+// one FDE from .eh_frame, for files that have no .eh_frame_hdr
+// search table
+typedef struct FdeEntry {
+        unsigned long pcBegin;
+        unsigned long fdeOffset;
+    } FdeEntry;
+
+
+typedef struct ElfFile {
+        char *path;
+        
+        // whole file mapped read-only, NULL if it couldn't be loaded
+        unsigned char *image;
+        unsigned long imageSize;
+        
+        // true if image is our own copy (of the vDSO) rather than
+        // a file mapping
+        char imageIsCopy;
+        
+        // hex, NULL if the file has none
+        char *buildID;
+        
+        // symbols and line tables, loaded the first time we name an
+        // address in this file
+        char debugInfoLoaded;
+        
+        // separate debug info file, or NULL
+        struct ElfFile *debugFile;
+        
+        // sorted by address
+        SimpleVector<ElfSymbol> symbols;
+        
+        SimpleVector<LineFile> lineFiles;
+        
+        // sorted by address, points into lineTable or cacheImage
+        LineEntry *lines;
+        int numLines;
+        
+        SimpleVector<LineEntry> lineTable;
+        
+        // our on-disk symbol cache for this build, mapped, or NULL
+        unsigned char *cacheImage;
+        unsigned long cacheImageSize;
+        
+        
+        // unwind info, located the first time we unwind through this file
+        char unwindInfoLoaded;
+        
+        unsigned char *ehFrame;
+        unsigned long ehFrameSize;
+        unsigned long ehFrameAddress;
+        
+        // .eh_frame_hdr, needed as the base for its search table entries
+        unsigned long ehFrameHdrAddress;
+        
+        // sorted (initial location, FDE address) pairs from .eh_frame_hdr,
+        // NULL if there's no usable table
+        int32_t *searchTable;
+        int searchTableSize;
+        
+        // our own sorted table, built from .eh_frame if searchTable is NULL
+        SimpleVector<FdeEntry> fdeTable;
+    } ElfFile;
+
+
+// one line from /proc/pid/maps
+typedef struct MemoryRegion {
+        unsigned long start;
+        unsigned long end;
+        unsigned long fileOffset;
+        char executable;
+        char *path;
+        
+        // NULL for anonymous regions or files that aren't ELF
+        ElfFile *elf;
+        
+        // add to an ELF virtual address to get the address in the target
+        unsigned long loadBias;
+    } MemoryRegion;
+
+
+
+// every ELF file we've ever looked at, loaded or not, so we only
+// try once per path
+SimpleVector<ElfFile *> elfFiles;
+
+// the target's current memory map, sorted by start address
+SimpleVector<MemoryRegion> memoryRegions;
+
+time_t memoryRegionsReadTime = 0;
+
+// goes up each time the map is read
+int memoryRegionsReadCount = 0;
+
+int memoryRegionsPID = -1;
+
+// held by the native backend's sampling thread while it unwinds, which 
+// can read the memory map again and add to elfFiles, and by the worker 
+// while it looks an address up in the map or adds a debug file
+// debug info is never loaded under it, since the target can be stopped
+// waiting for it
+std::mutex symbolTablesLock;
+
+
+
+static int compareElfSymbols( const void *inA, const void *inB ) {
+    const ElfSymbol *a = (const ElfSymbol *)inA;
+    const ElfSymbol *b = (const ElfSymbol *)inB;
+    
+    if( a->address < b->address ) {
+        return -1;
+        }
+    if( a->address > b->address ) {
+        return 1;
+        }
+    // bigger symbols first, so aliases without a size lose
+    if( a->size > b->size ) {
+        return -1;
+        }
+    if( a->size < b->size ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+static ElfW(Shdr) *getElfSection( ElfFile *inElf, int inIndex ) {
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inElf->image;
+
+    if( inIndex <= 0 || inIndex >= header->e_shnum ) {
+        return NULL;
+        }
+    unsigned long offset = header->e_shoff + inIndex * header->e_shentsize;
+    
+    if( offset + sizeof( ElfW(Shdr) ) > inElf->imageSize ) {
+        return NULL;
+        }
+    return (ElfW(Shdr) *)( inElf->image + offset );
+    }
+
+
+
+// adds function symbols from inSource, which is either ioDest itself or
+// its separate debug file
+static void addElfSymbols( ElfFile *inSource, ElfFile *ioDest ) {
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inSource->image;
+    
+    for( int i=1; i<header->e_shnum; i++ ) {
+        ElfW(Shdr) *section = getElfSection( inSource, i );
+        
+        if( section == NULL ||
+            ( section->sh_type != SHT_SYMTAB &&
+              section->sh_type != SHT_DYNSYM ) ) {
+            continue;
+            }
+        ElfW(Shdr) *strings = getElfSection( inSource, section->sh_link );
+        
+        if( strings == NULL ||
+            section->sh_offset + section->sh_size > inSource->imageSize ||
+            strings->sh_offset + strings->sh_size > inSource->imageSize ) {
+            continue;
+            }
+        
+        ElfW(Sym) *syms = 
+            (ElfW(Sym) *)( inSource->image + section->sh_offset );
+        int numSyms = section->sh_size / sizeof( ElfW(Sym) );
+        
+        const char *names = 
+            (const char *)( inSource->image + strings->sh_offset );
+        
+        for( int s=0; s<numSyms; s++ ) {
+            int type = ELF_NATIVE_ST_TYPE( syms[s].st_info );
+            
+            if( ( type != STT_FUNC && type != STT_GNU_IFUNC ) ||
+                syms[s].st_value == 0 ||
+                syms[s].st_shndx == SHN_UNDEF ||
+                syms[s].st_name >= strings->sh_size ) {
+                continue;
+                }
+            ElfSymbol sym = { syms[s].st_value, syms[s].st_size,
+                              &( names[ syms[s].st_name ] ), NULL };
+            ioDest->symbols.push_back( sym );
+            }
+        }
+    }
+
+
+
+static void sortElfSymbols( ElfFile *inElf ) {
+    if( inElf->symbols.size() == 0 ) {
+        return;
+        }
+    
+    qsort( inElf->symbols.getElementFast( 0 ), inElf->symbols.size(),
+           sizeof( ElfSymbol ), compareElfSymbols );
+    
+    // .symtab, .dynsym and debug files overlap, drop duplicate addresses
+    SimpleVector<ElfSymbol> unique;
+    for( int i=0; i<inElf->symbols.size(); i++ ) {
+        ElfSymbol *sym = inElf->symbols.getElementFast( i );
+        
+        if( unique.size() > 0 &&
+            unique.getLastElement()->address == sym->address ) {
+            continue;
+            }
+        unique.push_back( *sym );
+        }
+    inElf->symbols = unique;
+    }
+
+
+
+static ElfFile *newElfFile( const char *inPath ) {
+    ElfFile *e = new ElfFile;
+    e->path = stringDuplicate( inPath );
+    e->image = NULL;
+    e->imageSize = 0;
+    e->imageIsCopy = false;
+    e->unwindInfoLoaded = false;
+    e->ehFrame = NULL;
+    e->ehFrameSize = 0;
+    e->ehFrameAddress = 0;
+    e->ehFrameHdrAddress = 0;
+    e->searchTable = NULL;
+    e->searchTableSize = 0;
+    e->buildID = NULL;
+    e->debugInfoLoaded = false;
+    e->debugFile = NULL;
+    e->lines = NULL;
+    e->numLines = 0;
+    e->cacheImage = NULL;
+    e->cacheImageSize = 0;
+    elfFiles.push_back( e );
+    
+    return e;
+    }
+
+
+
+static char isElfImage( unsigned char *inImage, unsigned long inSize ) {
+    if( inSize < sizeof( ElfW(Ehdr) ) ) {
+        return false;
+        }
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inImage;
+
+    return ( memcmp( header->e_ident, ELFMAG, SELFMAG ) == 0 &&
+             header->e_ident[ EI_CLASS ] == ELF_NATIVE_CLASS );
+    }
+
+
+
+static ElfFile *getElfFile( const char *inPath ) {
+    for( int i=0; i<elfFiles.size(); i++ ) {
+        ElfFile *e = elfFiles.getElementDirect( i );
+        if( strcmp( e->path, inPath ) == 0 ) {
+            return e;
+            }
+        }
+    
+    ElfFile *e = newElfFile( inPath );
+    
+    int fd = open( inPath, O_RDONLY );
+    if( fd == -1 ) {
+        return e;
+        }
+    struct stat fileStat;
+    if( fstat( fd, &fileStat ) != 0 || 
+        fileStat.st_size < (long)sizeof( ElfW(Ehdr) ) ) {
+        close( fd );
+        return e;
+        }
+    
+    void *image = mmap( NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE,
+                        fd, 0 );
+    close( fd );
+    
+    if( image == MAP_FAILED ) {
+        return e;
+        }
+    
+    if( ! isElfImage( (unsigned char *)image, fileStat.st_size ) ) {
+        munmap( image, fileStat.st_size );
+        return e;
+        }
+    
+    e->image = (unsigned char *)image;
+    e->imageSize = fileStat.st_size;
+    
+    return e;
+    }
+
+
+
+// finds the load bias for the segment of inElf that was mapped at
+// inStart from inFileOffset
+static unsigned long getLoadBias( ElfFile *inElf, unsigned long inStart,
+                                  unsigned long inFileOffset ) {
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inElf->image;
+    
+    if( header->e_phoff + header->e_phnum * sizeof( ElfW(Phdr) ) >
+        inElf->imageSize ) {
+        return inStart - inFileOffset;
+        }
+    ElfW(Phdr) *phdrs = (ElfW(Phdr) *)( inElf->image + header->e_phoff );
+
+    unsigned long pageMask = sysconf( _SC_PAGESIZE ) - 1;
+    
+    for( int i=0; i<header->e_phnum; i++ ) {
+        ElfW(Phdr) *p = &( phdrs[i] );
+        
+        if( p->p_type == PT_LOAD &&
+            ( p->p_offset & ~pageMask ) <= inFileOffset &&
+            inFileOffset < p->p_offset + p->p_filesz ) {
+            
+            return inStart - inFileOffset - ( p->p_vaddr - p->p_offset );
+            }
+        }
+    return inStart - inFileOffset;
+    }
+
+
+
+static char readProcessMemory( int inPID, unsigned long inAddress, 
+                               void *outBuffer, int inLength ) {
+    struct iovec local = { outBuffer, (size_t)inLength };
+    struct iovec remote = { (void *)inAddress, (size_t)inLength };
+    
+    return ( process_vm_readv( inPID, &local, 1, &remote, 1, 0 ) == 
+             inLength );
+    }
+
+
+
+static char readNativeMemory( unsigned long inAddress, void *outBuffer,
+                              int inLength );
+
+
+// the vDSO isn't a file we can open, but the kernel maps a complete
+// ELF image of it into the target, so we copy that out instead
+static ElfFile *getVdsoElfFile( int inPID, MemoryRegion *inRegion ) {
+    for( int i=0; i<elfFiles.size(); i++ ) {
+        ElfFile *e = elfFiles.getElementDirect( i );
+        if( strcmp( e->path, inRegion->path ) == 0 ) {
+            return e;
+            }
+        }
+    
+    ElfFile *e = newElfFile( inRegion->path );
+    
+    unsigned long size = inRegion->end - inRegion->start;
+    unsigned char *image = new unsigned char[ size ];
+    
+    // GDB may be the one tracing the target, so try without ptrace first
+    if( ( ! readProcessMemory( inPID, inRegion->start, image, size ) &&
+          ! readNativeMemory( inRegion->start, image, size ) ) ||
+        ! isElfImage( image, size ) ) {
+        delete [] image;
+        return e;
+        }
+    
+    e->image = image;
+    e->imageSize = size;
+    e->imageIsCopy = true;
+    
+    return e;
+    }
+
+
+
+static void freeMemoryRegions() {
+    for( int i=0; i<memoryRegions.size(); i++ ) {
+        delete [] memoryRegions.getElementFast( i )->path;
+        }
+    memoryRegions.deleteAll();
+    }
+
+
+
+static void readMemoryRegions( int inPID ) {
+    memoryRegionsReadTime = time( NULL );
+    memoryRegionsReadCount++;
+    memoryRegionsPID = inPID;
+    
+    char *mapsName = autoSprintf( "/proc/%d/maps", inPID );
+    FILE *mapsFile = fopen( mapsName, "r" );
+    delete [] mapsName;
+    
+    if( mapsFile == NULL ) {
+        // target is gone, but the last snapshot is still good for
+        // naming the addresses we sampled
+        return;
+        }
+    
+    freeMemoryRegions();
+    
+    char line[4096];
+    
+    while( fgets( line, sizeof( line ), mapsFile ) != NULL ) {
+        MemoryRegion r;
+        char perms[8];
+        int pathStart = 0;
+        
+        if( sscanf( line, "%lx-%lx %7s %lx %*s %*d %n", 
+                    &r.start, &r.end, perms, &r.fileOffset,
+                    &pathStart ) < 4 ) {
+            continue;
+            }
+        
+        char *path = &( line[ pathStart ] );
+        char *newline = strstr( path, "\n" );
+        if( newline != NULL ) {
+            newline[0] = '\0';
+            }
+        
+        r.executable = ( strstr( perms, "x" ) != NULL );
+        r.path = stringDuplicate( path );
+        r.elf = NULL;
+        r.loadBias = 0;
+        
+        if( r.executable && path[0] == '/' ) {
+            r.elf = getElfFile( path );
+            }
+        else if( r.executable && strcmp( path, "[vdso]" ) == 0 ) {
+            r.elf = getVdsoElfFile( inPID, &r );
+            }
+        
+        if( r.elf != NULL ) {
+            if( r.elf->image == NULL ) {
+                r.elf = NULL;
+                }
+            else {
+                r.loadBias = getLoadBias( r.elf, r.start, r.fileOffset );
+                }
+            }
+        memoryRegions.push_back( r );
+        }
+    
+    fclose( mapsFile );
+    }
+
+
+
+static MemoryRegion *findMemoryRegion( unsigned long inAddress ) {
+    int low = 0;
+    int high = memoryRegions.size() - 1;
+    
+    while( low <= high ) {
+        int mid = ( low + high ) / 2;
+        MemoryRegion *r = memoryRegions.getElementFast( mid );
+        
+        if( inAddress < r->start ) {
+            high = mid - 1;
+            }
+        else if( inAddress >= r->end ) {
+            low = mid + 1;
+            }
+        else {
+            return r;
+            }
+        }
+    return NULL;
+    }
+
+
+
+// finds the code region containing inPC, re-reading the target's
+// memory map if it looks like new code was loaded
+static MemoryRegion *findCodeRegion( unsigned long inPC ) {
+    MemoryRegion *r = findMemoryRegion( inPC );
+    
+    // but junk addresses from a bad frame could have us re-reading the
+    // map every sample, so do it at most once a second
+    if( ( r == NULL || ! r->executable ) &&
+        time( NULL ) != memoryRegionsReadTime ) {
+        readMemoryRegions( memoryRegionsPID );
+        r = findMemoryRegion( inPC );
+        }
+    
+    if( r != NULL && ! r->executable ) {
+        return NULL;
+        }
+    return r;
+    }
+
+
+
+// returns NULL if no symbol covers inAddress
+static const char *lookupElfSymbol( ElfFile *inElf, unsigned long inAddress ) {
+    int low = 0;
+    int high = inElf->symbols.size() - 1;
+    int found = -1;
+    
+    // last symbol that starts at or before inAddress
+    while( low <= high ) {
+        int mid = ( low + high ) / 2;
+        
+        if( inElf->symbols.getElementFast( mid )->address <= inAddress ) {
+            found = mid;
+            low = mid + 1;
+            }
+        else {
+            high = mid - 1;
+            }
+        }
+    
+    if( found == -1 ) {
+        return NULL;
+        }
+    ElfSymbol *sym = inElf->symbols.getElementFast( found );
+    
+    if( sym->size > 0 && inAddress >= sym->address + sym->size ) {
+        return NULL;
+        }
+    
+    if( sym->demangledName == NULL ) {
+        int status;
+        char *demangled = abi::__cxa_demangle( sym->name, NULL, NULL, 
+                                               &status );
+        if( demangled != NULL && status == 0 ) {
+            sym->demangledName = stringDuplicate( demangled );
+            }
+        else {
+            sym->demangledName = stringDuplicate( sym->name );
+            }
+        free( demangled );
+        }
+    return sym->demangledName;
+    }
+
+
+
+static void freeElfFiles() {
+    freeMemoryRegions();
+    
+    for( int i=0; i<elfFiles.size(); i++ ) {
+        ElfFile *e = elfFiles.getElementDirect( i );
+        
+        for( int s=0; s<e->symbols.size(); s++ ) {
+            delete [] e->symbols.getElementFast( s )->demangledName;
+            }
+        if( e->cacheImage != NULL ) {
+            munmap( e->cacheImage, e->cacheImageSize );
+            }
+        delete [] e->buildID;
+        
+        if( e->imageIsCopy ) {
+            delete [] e->image;
+            }
+        else if( e->image != NULL ) {
+            munmap( e->image, e->imageSize );
+            }
+        delete [] e->path;
+        delete e;
+        }
+    elfFiles.deleteAll();
+    }
+
+
+
+
+// **************************************
+// native ptrace backend
+
+// stops the target with PTRACE_INTERRUPT and walks its stack ourselves,
+// so a sample costs a few syscalls instead of three GDB round trips
+
+
+int nativePID = -1;
+
+
+typedef struct NativeThread {
+        int tid;
+        // from /proc, re-read now and then since threads name themselves
+        // after they start
+        char *name;
+        time_t nameReadTime;
+        
+        // true while the thread is in a ptrace-stop we can sample
+        char stopped;
+        
+        // true if the thread was stopped by job control (SIGSTOP, etc.) 
+        // rather than by us, in which case it has to be left stopped 
+        // when we resume it
+        char inGroupStop;
+    } NativeThread;
+
+
+// every thread of the target, all traced
+SimpleVector<NativeThread> nativeThreads;
+
+// the thread whose stack we're reading
+int nativeCurrentTID = -1;
+
+// frames unwound for the thread being captured, with room for one past
+// maxStackDepth, so frame chains aren't followed forever
+unsigned long *nativeFramePCs = NULL;
+char *nativeFrameIsCaller = NULL;
+
+
+// registers are kept in DWARF numbering so the CFI unwinder can
+// index them directly
+#if defined(__x86_64__)
+    #define NUM_DWARF_REGISTERS 17
+    #define DWARF_SP_REGISTER 7
+    #define DWARF_FP_REGISTER 6
+#elif defined(__i386__)
+    #define NUM_DWARF_REGISTERS 9
+    #define DWARF_SP_REGISTER 4
+    #define DWARF_FP_REGISTER 5
+#elif defined(__aarch64__)
+    #define NUM_DWARF_REGISTERS 32
+    #define DWARF_SP_REGISTER 31
+    #define DWARF_FP_REGISTER 29
+#else
+    #define NUM_DWARF_REGISTERS 1
+    #define DWARF_SP_REGISTER 0
+    #define DWARF_FP_REGISTER 0
+#endif
+
+
+typedef struct NativeRegisters {
+        unsigned long pc;
+        unsigned long regs[ NUM_DWARF_REGISTERS ];
+    } NativeRegisters;
+
+
+
+// called while sampling, so this only allocates if the name changed
+static void readNativeThreadName( NativeThread *inThread ) {
+    inThread->nameReadTime = time( NULL );
+    
+    char commName[64];
+    snprintf( commName, sizeof( commName ), "/proc/%d/task/%d/comm", 
+              nativePID, inThread->tid );
+    
+    int commFD = open( commName, O_RDONLY );
+    
+    if( commFD == -1 ) {
+        return;
+        }
+    
+    char name[64];
+    
+    int numRead = read( commFD, name, sizeof( name ) - 1 );
+    close( commFD );
+    
+    if( numRead <= 0 ) {
+        return;
+        }
+    name[ numRead ] = '\0';
+    
+    char *newline = strstr( name, "\n" );
+    if( newline != NULL ) {
+        newline[0] = '\0';
+        }
+    
+    if( strcmp( name, inThread->name ) != 0 ) {
+        delete [] inThread->name;
+        inThread->name = stringDuplicate( name );
+        }
+    }
+
+
+
+static int findNativeThread( int inTID ) {
+    for( int i=0; i<nativeThreads.size(); i++ ) {
+        if( nativeThreads.getElementFast( i )->tid == inTID ) {
+            return i;
+            }
+        }
+    return -1;
+    }
+
+
+
+static NativeThread *addNativeThread( int inTID ) {
+    NativeThread t;
+    t.tid = inTID;
+    t.name = stringDuplicate( "?" );
+    t.stopped = false;
+    t.inGroupStop = false;
+    
+    readNativeThreadName( &t );
+    
+    nativeThreads.push_back( t );
+    
+    return nativeThreads.getLastElement();
+    }
+
+
+
+static void removeNativeThread( int inIndex ) {
+    delete [] nativeThreads.getElementFast( inIndex )->name;
+    nativeThreads.deleteElement( inIndex );
+    }
+
+
+
+static void freeNativeThreads() {
+    for( int i=0; i<nativeThreads.size(); i++ ) {
+        delete [] nativeThreads.getElementFast( i )->name;
+        }
+    nativeThreads.deleteAll();
+    }
+
+
+
+// seizes every thread of inPID, and has threads it creates later
+// traced automatically
+static char startNativeTrace( int inPID, char inKillOnExit ) {
+    long options = PTRACE_O_TRACECLONE;
+    
+    if( inKillOnExit ) {
+        options |= PTRACE_O_EXITKILL;
+        }
+    
+    if( ptrace( PTRACE_SEIZE, inPID, NULL, (void *)options ) == -1 ) {
+        if( errno == ESRCH ) {
+            printf( "Could not find process:  %d\n", inPID );
+            }
+        else if( errno == EPERM ) {
+            printf( "Could not attach to process %d "
+                    "(maybe you need to be root?)\n", inPID );
+            }
+        else {
+            printf( "Failed to attach to process %d:  %s\n", inPID,
+                    strerror( errno ) );
+            }
+        return false;
+        }
+    nativePID = inPID;
+    nativeCurrentTID = inPID;
+    
+    // runNativeTarget waits for this instead of sleeping
+    sigset_t childSignal;
+    sigemptyset( &childSignal );
+    sigaddset( &childSignal, SIGCHLD );
+    sigprocmask( SIG_BLOCK, &childSignal, NULL );
+    
+    addNativeThread( inPID );
+    
+    // threads that weren't traced yet can create new ones while we
+    // work through the list, so keep going until a pass finds nothing
+    char *taskDirName = autoSprintf( "/proc/%d/task", inPID );
+    char foundNew = true;
+    
+    while( foundNew ) {
+        foundNew = false;
+        
+        DIR *taskDir = opendir( taskDirName );
+        
+        if( taskDir == NULL ) {
+            break;
+            }
+        struct dirent *entry;
+        
+        while( ( entry = readdir( taskDir ) ) != NULL ) {
+            int tid = atoi( entry->d_name );
+            
+            if( tid <= 0 || findNativeThread( tid ) != -1 ) {
+                continue;
+                }
+            // it may have exited already
+            if( ptrace( PTRACE_SEIZE, tid, NULL, (void *)options ) == 0 ) {
+                addNativeThread( tid );
+                foundNew = true;
+                }
+            }
+        closedir( taskDir );
+        }
+    delete [] taskDirName;
+    
+    return true;
+    }
+
+
+
+// runs inProgName with inProgArgs through the shell, output redirected
+// to wcOut.txt like the GDB backend does, and traces it from the start
+// returns the child's PID, or -1 on failure
+static int launchNativeTarget( const char *inProgName, 
+                               const char *inProgArgs ) {
+    int goPipe[2];
+    if( pipe( goPipe ) != 0 ) {
+        return -1;
+        }
+    
+    char *command = autoSprintf( "exec %s %s > wcOut.txt", 
+                                 inProgName, inProgArgs );
+    
+    int childPID = fork();
+    
+    if( childPID == -1 ) {
+        delete [] command;
+        return -1;
+        }
+    else if( childPID == 0 ) {
+        // child
+        // wait until our parent has started tracing us
+        close( goPipe[1] );
+        char go;
+        read( goPipe[0], &go, 1 );
+        close( goPipe[0] );
+        
+        execl( "/bin/sh", "sh", "-c", command, (char *)NULL );
+        exit( 1 );
+        }
+    
+    delete [] command;
+    close( goPipe[0] );
+    
+    printf( "\n\nStarting program '%s %s' under ptrace, "
+            "redirecting program output to wcOut.txt\n",
+            inProgName, inProgArgs );
+    
+    char traced = startNativeTrace( childPID, true );
+    
+    char go = 1;
+    write( goPipe[1], &go, 1 );
+    close( goPipe[1] );
+    
+    if( !traced ) {
+        kill( childPID, SIGKILL );
+        waitpid( childPID, NULL, 0 );
+        return -1;
+        }
+    return childPID;
+    }
+
+
+
+static int countUnstoppedNativeThreads() {
+    int count = 0;
+    for( int i=0; i<nativeThreads.size(); i++ ) {
+        if( ! nativeThreads.getElementFast( i )->stopped ) {
+            count++;
+            }
+        }
+    return count;
+    }
+
+
+
+// deals with one status from waitpid for thread inTID
+// keeps threads running through signals and ptrace events other than
+// the stops we asked for, and tracks threads being created and exiting
+// returns false if the target exited
+static char handleNativeWaitStatus( int inTID, int inStatus ) {
+    int index = findNativeThread( inTID );
+    
+    if( WIFEXITED( inStatus ) || WIFSIGNALED( inStatus ) ) {
+        if( index != -1 ) {
+            removeNativeThread( index );
+            }
+        // the main thread's exit is only reported once the whole
+        // process is gone
+        if( inTID == nativePID || nativeThreads.size() == 0 ) {
+            programExited = true;
+            return false;
+            }
+        return true;
+        }
+    if( ! WIFSTOPPED( inStatus ) ) {
+        return true;
+        }
+    
+    NativeThread *t;
+    
+    if( index == -1 ) {
+        // a new thread can report its first stop before its
+        // creator reports the clone
+        t = addNativeThread( inTID );
+        }
+    else {
+        t = nativeThreads.getElementFast( index );
+        }
+    
+    int sig = WSTOPSIG( inStatus );
+    int event = inStatus >> 16;
+    
+    if( event == PTRACE_EVENT_STOP ) {
+        t->stopped = true;
+        t->inGroupStop = ( sig == SIGSTOP || sig == SIGTSTP ||
+                           sig == SIGTTIN || sig == SIGTTOU );
+        }
+    else if( event == PTRACE_EVENT_CLONE ) {
+        unsigned long newTID;
+        
+        if( ptrace( PTRACE_GETEVENTMSG, inTID, NULL, &newTID ) == 0 &&
+            findNativeThread( newTID ) == -1 ) {
+            // its first stop is on the way
+            addNativeThread( newTID );
+            }
+        ptrace( PTRACE_CONT, inTID, NULL, NULL );
+        }
+    else if( event != 0 ) {
+        // some other ptrace event, let it proceed
+        ptrace( PTRACE_CONT, inTID, NULL, NULL );
+        }
+    else {
+        // signal-delivery-stop, thread still gets its signal
+        ptrace( PTRACE_CONT, inTID, NULL, (void *)(long)sig );
+        }
+    return true;
+    }
+
+
+
+// waits until every thread reports a stop that we can sample
+// returns false if the target exited
+static char waitForNativeStops() {
+    while( countUnstoppedNativeThreads() > 0 ) {
+        int status;
+        
+        int tid = waitpid( -1, &status, __WALL );
+        
+        if( tid == -1 ) {
+            if( errno == EINTR ) {
+                continue;
+                }
+            programExited = true;
+            return false;
+            }
+        
+        if( ! handleNativeWaitStatus( tid, status ) ) {
+            return false;
+            }
+        }
+    return true;
+    }
+
+
+
+static char interruptNativeTarget() {
+    for( int i=0; i<nativeThreads.size(); i++ ) {
+        NativeThread *t = nativeThreads.getElementFast( i );
+        
+        t->stopped = false;
+        
+        // fails if the thread just exited, which waitpid will tell us
+        ptrace( PTRACE_INTERRUPT, t->tid, NULL, NULL );
+        }
+    return waitForNativeStops();
+    }
+
+
+
+static void continueNativeThread( NativeThread *inThread ) {
+    if( inThread->inGroupStop ) {
+        ptrace( PTRACE_LISTEN, inThread->tid, NULL, NULL );
+        }
+    else {
+        ptrace( PTRACE_CONT, inThread->tid, NULL, NULL );
+        }
+    inThread->stopped = false;
+    }
+
+
+
+static void continueNativeTarget() {
+    for( int i=0; i<nativeThreads.size(); i++ ) {
+        continueNativeThread( nativeThreads.getElementFast( i ) );
+        }
+    }
+
+
+
+// waits until inDeadline, on the getMicroseconds clock, while the 
+// target runs, but handles its signals and thread creation as they 
+// happen, rather than leaving those threads stopped until the next 
+// sample
+static void runNativeTarget( double inDeadline ) {
+    sigset_t childSignal;
+    sigemptyset( &childSignal );
+    sigaddset( &childSignal, SIGCHLD );
+    
+    while( ! programExited ) {
+        int status;
+        int tid;
+        
+        while( ( tid = waitpid( -1, &status, __WALL | WNOHANG ) ) > 0 ) {
+            if( ! handleNativeWaitStatus( tid, status ) ) {
+                return;
+                }
+            }
+        if( tid == -1 && errno == ECHILD ) {
+            programExited = true;
+            return;
+            }
+        
+        // new threads and group stops report stops we didn't ask for
+        for( int i=0; i<nativeThreads.size(); i++ ) {
+            NativeThread *t = nativeThreads.getElementFast( i );
+            
+            if( t->stopped ) {
+                continueNativeThread( t );
+                }
+            }
+        
+        long long remaining = 
+            llrint( ( inDeadline - getMicroseconds() ) * 1000 );
+        
+        if( remaining <= 0 ) {
+            return;
+            }
+        
+        struct timespec timeout;
+        timeout.tv_sec = remaining / 1000000000LL;
+        timeout.tv_nsec = remaining % 1000000000LL;
+        
+        // SIGCHLD is blocked, so it waits here for us
+        sigtimedwait( &childSignal, NULL, &timeout );
+        }
+    }
+
+
+
+static void detachNativeTarget() {
+    if( interruptNativeTarget() ) {
+        for( int i=0; i<nativeThreads.size(); i++ ) {
+            ptrace( PTRACE_DETACH, nativeThreads.getElementFast( i )->tid, 
+                    NULL, NULL );
+            }
+        }
+    freeNativeThreads();
+    }
+
+
+
+static char getNativeRegisters( int inTID, NativeRegisters *outRegs ) {
+#if defined(__x86_64__) || defined(__i386__)
+    struct user_regs_struct regs;
+#elif defined(__aarch64__)
+    struct user_pt_regs regs;
+#else
+    struct { long unused; } regs;
+    
+    printf( "The ptrace backend doesn't support this architecture\n" );
+    return false;
+#endif
+    
+    struct iovec regsVec = { &regs, sizeof( regs ) };
+    
+    if( ptrace( PTRACE_GETREGSET, inTID, (void *)NT_PRSTATUS, 
+                &regsVec ) == -1 ) {
+        return false;
+        }
+
+    memset( outRegs, 0, sizeof( NativeRegisters ) );
+    
+#if defined(__x86_64__)
+    outRegs->pc = regs.rip;
+    
+    unsigned long *r = outRegs->regs;
+    r[0] = regs.rax;
+    r[1] = regs.rdx;
+    r[2] = regs.rcx;
+    r[3] = regs.rbx;
+    r[4] = regs.rsi;
+    r[5] = regs.rdi;
+    r[6] = regs.rbp;
+    r[7] = regs.rsp;
+    r[8] = regs.r8;
+    r[9] = regs.r9;
+    r[10] = regs.r10;
+    r[11] = regs.r11;
+    r[12] = regs.r12;
+    r[13] = regs.r13;
+    r[14] = regs.r14;
+    r[15] = regs.r15;
+    r[16] = regs.rip;
+#elif defined(__i386__)
+    outRegs->pc = regs.eip;
+    
+    unsigned long *r = outRegs->regs;
+    r[0] = regs.eax;
+    r[1] = regs.ecx;
+    r[2] = regs.edx;
+    r[3] = regs.ebx;
+    r[4] = regs.esp;
+    r[5] = regs.ebp;
+    r[6] = regs.esi;
+    r[7] = regs.edi;
+    r[8] = regs.eip;
+#elif defined(__aarch64__)
+    outRegs->pc = regs.pc;
+    
+    for( int i=0; i<31; i++ ) {
+        outRegs->regs[i] = regs.regs[i];
+        }
+    outRegs->regs[31] = regs.sp;
+#endif
+    return true;
+    }
+
+
+
+static char readNativeMemory( unsigned long inAddress, void *outBuffer,
+                              int inLength ) {
+    if( readProcessMemory( nativeCurrentTID, inAddress, outBuffer, 
+                           inLength ) ) {
+        return true;
+        }
+    
+    // process_vm_readv can be disabled, fall back to one word at a time
+    unsigned char *out = (unsigned char *)outBuffer;
+    int wordSize = sizeof( long );
+    
+    for( int i=0; i<inLength; i += wordSize ) {
+        errno = 0;
+        long word = ptrace( PTRACE_PEEKDATA, nativeCurrentTID, 
+                            (void *)( inAddress + i ), NULL );
+        if( errno != 0 ) {
+            return false;
+            }
+        int numToCopy = inLength - i;
+        if( numToCopy > wordSize ) {
+            numToCopy = wordSize;
+            }
+        memcpy( &( out[i] ), &word, numToCopy );
+        }
+    return true;
+    }
+
+
+
+// **************************************
+// DWARF CFI unwinder for the native backend
+
+// optimized code doesn't keep a frame pointer chain, so we unwind
+// with the same .eh_frame call frame information that C++ exceptions
+// use.  Each file's tables are located once and searched by PC.
+
+
+// a copy of the top of the target's stack, taken while it's stopped
+// so that unwinding doesn't need a syscall for every word it reads
+#define STACK_COPY_SIZE 65536
+
+typedef struct StackCopy {
+        unsigned long start;
+        unsigned long size;
+        unsigned char data[ STACK_COPY_SIZE ];
+    } StackCopy;
+
+StackCopy nativeStackCopy;
+
+
+
+static void copyNativeStack( unsigned long inSP, StackCopy *outCopy ) {
+    unsigned long end = inSP + STACK_COPY_SIZE;
+    
+    MemoryRegion *r = findMemoryRegion( inSP );
+    
+    if( r != NULL && r->end < end ) {
+        end = r->end;
+        }
+    
+    outCopy->start = inSP;
+    outCopy->size = 0;
+    
+    struct iovec local = { outCopy->data, end - inSP };
+    struct iovec remote = { (void *)inSP, end - inSP };
+    
+    long numRead = process_vm_readv( nativeCurrentTID, &local, 1, 
+                                     &remote, 1, 0 );
+    
+    if( numRead > 0 ) {
+        outCopy->size = numRead;
+        }
+    }
+
+
+
+static char readUnwindMemory( StackCopy *inCopy, unsigned long inAddress, 
+                              void *outBuffer, int inLength ) {
+    if( inAddress >= inCopy->start &&
+        inAddress + inLength <= inCopy->start + inCopy->size ) {
+        
+        memcpy( outBuffer, &( inCopy->data[ inAddress - inCopy->start ] ), 
+                inLength );
+        return true;
+        }
+    // off the copied part of the stack, signal frame on an alternate
+    // stack, etc.
+    return readNativeMemory( inAddress, outBuffer, inLength );
+    }
+
+
+
+// pointer encodings used in .eh_frame and .eh_frame_hdr
+#define DW_EH_PE_absptr   0x00
+#define DW_EH_PE_uleb128  0x01
+#define DW_EH_PE_udata2   0x02
+#define DW_EH_PE_udata4   0x03
+#define DW_EH_PE_udata8   0x04
+#define DW_EH_PE_sleb128  0x09
+#define DW_EH_PE_sdata2   0x0a
+#define DW_EH_PE_sdata4   0x0b
+#define DW_EH_PE_sdata8   0x0c
+#define DW_EH_PE_pcrel    0x10
+#define DW_EH_PE_datarel  0x30
+#define DW_EH_PE_indirect 0x80
+#define DW_EH_PE_omit     0xff
+
+
+// a chunk of an ELF image along with the virtual address it's loaded at,
+// for decoding PC-relative pointers
+typedef struct EhSection {
+        unsigned char *data;
+        unsigned char *end;
+        unsigned long address;
+    } EhSection;
+
+
+
+static unsigned long readULEB128( unsigned char **ioPos, unsigned char *inEnd ) {
+    unsigned long result = 0;
+    int shift = 0;
+    
+    while( *ioPos < inEnd ) {
+        unsigned char b = **ioPos;
+        (*ioPos)++;
+        
+        if( shift < 64 ) {
+            result |= (unsigned long)( b & 0x7f ) << shift;
+            }
+        shift += 7;
+        
+        if( ( b & 0x80 ) == 0 ) {
+            break;
+            }
+        }
+    return result;
+    }
+
+
+
+static long readSLEB128( unsigned char **ioPos, unsigned char *inEnd ) {
+    long result = 0;
+    int shift = 0;
+    unsigned char b = 0;
+    
+    while( *ioPos < inEnd ) {
+        b = **ioPos;
+        (*ioPos)++;
+        
+        if( shift < 64 ) {
+            result |= (long)( b & 0x7f ) << shift;
+            }
+        shift += 7;
+        
+        if( ( b & 0x80 ) == 0 ) {
+            break;
+            }
+        }
+    if( shift < 64 && ( b & 0x40 ) ) {
+        // sign extend
+        result |= - ( 1L << shift );
+        }
+    return result;
+    }
+
+
+
+// reads an unaligned, fixed-size little-endian integer
+static char readFixed( unsigned char **ioPos, unsigned char *inEnd,
+                       int inSize, unsigned long *outValue ) {
+    if( *ioPos + inSize > inEnd ) {
+        return false;
+        }
+    unsigned long value = 0;
+    memcpy( &value, *ioPos, inSize );
+    *ioPos += inSize;
+    
+    *outValue = value;
+    return true;
+    }
+
+
+
+static char readEncodedPointer( unsigned char **ioPos, EhSection *inSection,
+                                int inEncoding, unsigned long inDataBase,
+                                unsigned long *outValue ) {
+    if( inEncoding == DW_EH_PE_omit ) {
+        *outValue = 0;
+        return true;
+        }
+    
+    unsigned long fieldAddress = 
+        inSection->address + ( *ioPos - inSection->data );
+    
+    unsigned long value;
+    
+    switch( inEncoding & 0x0f ) {
+        case DW_EH_PE_absptr:
+            if( ! readFixed( ioPos, inSection->end, sizeof( long ), 
+                             &value ) ) {
+                return false;
+                }
+            break;
+        case DW_EH_PE_uleb128:
+            value = readULEB128( ioPos, inSection->end );
+            break;
+        case DW_EH_PE_sleb128:
+            value = readSLEB128( ioPos, inSection->end );
+            break;
+        case DW_EH_PE_udata2:
+        case DW_EH_PE_sdata2:
+            if( ! readFixed( ioPos, inSection->end, 2, &value ) ) {
+                return false;
+                }
+            if( ( inEncoding & 0x0f ) == DW_EH_PE_sdata2 ) {
+                value = (long)(int16_t)value;
+                }
+            break;
+        case DW_EH_PE_udata4:
+        case DW_EH_PE_sdata4:
+            if( ! readFixed( ioPos, inSection->end, 4, &value ) ) {
+                return false;
+                }
+            if( ( inEncoding & 0x0f ) == DW_EH_PE_sdata4 ) {
+                value = (long)(int32_t)value;
+                }
+            break;
+        case DW_EH_PE_udata8:
+        case DW_EH_PE_sdata8:
+            if( ! readFixed( ioPos, inSection->end, 8, &value ) ) {
+                return false;
+                }
+            break;
+        default:
+            return false;
+        }
+    
+    switch( inEncoding & 0x70 ) {
+        case DW_EH_PE_pcrel:
+            value += fieldAddress;
+            break;
+        case DW_EH_PE_datarel:
+            value += inDataBase;
+            break;
+        default:
+            break;
+        }
+    
+    // indirect pointers only show up for personality routines, which
+    // we never dereference
+    
+    *outValue = value;
+    return true;
+    }
+
+
+
+typedef struct CieInfo {
+        unsigned long codeAlign;
+        long dataAlign;
+        int returnAddressRegister;
+        int fdeEncoding;
+        int lsdaEncoding;
+        char hasAugmentationData;
+        // 'S' augmentation, this is a signal trampoline
+        char isSignalFrame;
+        unsigned char *instructions;
+        unsigned char *instructionsEnd;
+    } CieInfo;
+
+
+typedef struct FdeInfo {
+        unsigned long pcBegin;
+        unsigned long pcEnd;
+        unsigned char *instructions;
+        unsigned char *instructionsEnd;
+        CieInfo cie;
+    } FdeInfo;
+
+
+
+// reads the length field of the .eh_frame entry at inPos
+// sets *outBody to the start of the entry's contents and returns a
+// pointer to the next entry, or NULL at the end of the section
+static unsigned char *readEhFrameEntryLength( unsigned char *inPos,
+                                              unsigned char *inEnd,
+                                              unsigned char **outBody ) {
+    unsigned long length;
+    unsigned char *pos = inPos;
+    
+    if( ! readFixed( &pos, inEnd, 4, &length ) || length == 0 ) {
+        return NULL;
+        }
+    if( length == 0xffffffff ) {
+        if( ! readFixed( &pos, inEnd, 8, &length ) ) {
+            return NULL;
+            }
+        }
+    if( length > (unsigned long)( inEnd - pos ) ) {
+        return NULL;
+        }
+    *outBody = pos;
+    return pos + length;
+    }
+
+
+
+static char parseCie( EhSection *inEhFrame, unsigned char *inCie, 
+                      CieInfo *outCie ) {
+    unsigned char *body;
+    unsigned char *end = readEhFrameEntryLength( inCie, inEhFrame->end, 
+                                                 &body );
+    if( end == NULL ) {
+        return false;
+        }
+    unsigned char *pos = body;
+    
+    unsigned long id;
+    if( ! readFixed( &pos, end, 4, &id ) || id != 0 || pos >= end ) {
+        return false;
+        }
+    
+    int version = *pos;
+    pos++;
+    
+    const char *augmentation = (const char *)pos;
+    while( pos < end && *pos != '\0' ) {
+        pos++;
+        }
+    pos++;
+    
+    if( pos >= end ) {
+        return false;
+        }
+    
+    if( strstr( augmentation, "eh" ) != NULL ) {
+        // old GCC eh_ptr
+        pos += sizeof( long );
+        }
+    
+    outCie->codeAlign = readULEB128( &pos, end );
+    outCie->dataAlign = readSLEB128( &pos, end );
+    
+    if( version == 1 ) {
+        outCie->returnAddressRegister = *pos;
+        pos++;
+        }
+    else {
+        outCie->returnAddressRegister = readULEB128( &pos, end );
+        }
+    
+    outCie->fdeEncoding = DW_EH_PE_absptr;
+    outCie->lsdaEncoding = DW_EH_PE_omit;
+    outCie->hasAugmentationData = false;
+    outCie->isSignalFrame = false;
+    
+    unsigned char *augmentationEnd = NULL;
+    
+    for( const char *a = augmentation; *a != '\0'; a++ ) {
+        if( *a == 'z' ) {
+            unsigned long length = readULEB128( &pos, end );
+            outCie->hasAugmentationData = true;
+            augmentationEnd = pos + length;
+            }
+        else if( *a == 'R' ) {
+            outCie->fdeEncoding = *pos;
+            pos++;
+            }
+        else if( *a == 'L' ) {
+            outCie->lsdaEncoding = *pos;
+            pos++;
+            }
+        else if( *a == 'P' ) {
+            int encoding = *pos;
+            pos++;
+            unsigned long personality;
+            if( ! readEncodedPointer( &pos, inEhFrame, encoding & 0x7f, 0,
+                                      &personality ) ) {
+                return false;
+                }
+            }
+        else if( *a == 'S' ) {
+            outCie->isSignalFrame = true;
+            }
+        else if( *a == 'e' || *a == 'h' ) {
+            // handled above
+            }
+        else if( augmentationEnd != NULL ) {
+            // unknown, but we can skip the rest of the augmentation data
+            break;
+            }
+        else {
+            return false;
+            }
+        }
+    
+    if( augmentationEnd != NULL ) {
+        pos = augmentationEnd;
+        }
+    if( pos > end ) {
+        return false;
+        }
+    
+    outCie->instructions = pos;
+    outCie->instructionsEnd = end;
+    return true;
+    }
+
+
+
+// inFde points at the length field of an FDE
+static char parseFde( EhSection *inEhFrame, unsigned char *inFde, 
+                      FdeInfo *outFde ) {
+    unsigned char *body;
+    unsigned char *end = readEhFrameEntryLength( inFde, inEhFrame->end, 
+                                                 &body );
+    if( end == NULL ) {
+        return false;
+        }
+    unsigned char *pos = body;
+    
+    unsigned long ciePointer;
+    if( ! readFixed( &pos, end, 4, &ciePointer ) || ciePointer == 0 ) {
+        // a CIE, not an FDE
+        return false;
+        }
+    
+    // relative to the CIE pointer field itself
+    unsigned char *cie = body - ciePointer;
+    
+    if( cie < inEhFrame->data || cie >= inEhFrame->end ||
+        ! parseCie( inEhFrame, cie, &( outFde->cie ) ) ) {
+        return false;
+        }
+    
+    unsigned long range;
+    
+    if( ! readEncodedPointer( &pos, inEhFrame, outFde->cie.fdeEncoding, 0,
+                              &( outFde->pcBegin ) ) ||
+        ! readEncodedPointer( &pos, inEhFrame, 
+                              outFde->cie.fdeEncoding & 0x0f, 0,
+                              &range ) ) {
+        return false;
+        }
+    outFde->pcEnd = outFde->pcBegin + range;
+    
+    if( outFde->cie.hasAugmentationData ) {
+        unsigned long length = readULEB128( &pos, end );
+        pos += length;
+        }
+    if( pos > end ) {
+        return false;
+        }
+    
+    outFde->instructions = pos;
+    outFde->instructionsEnd = end;
+    return true;
+    }
+
+
+
+// maps an ELF virtual address to a pointer into the file image
+static unsigned char *getElfImageAddress( ElfFile *inElf, 
+                                          unsigned long inAddress ) {
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inElf->image;
+    
+    if( header->e_phoff + header->e_phnum * sizeof( ElfW(Phdr) ) >
+        inElf->imageSize ) {
+        return NULL;
+        }
+    ElfW(Phdr) *phdrs = (ElfW(Phdr) *)( inElf->image + header->e_phoff );
+    
+    for( int i=0; i<header->e_phnum; i++ ) {
+        ElfW(Phdr) *p = &( phdrs[i] );
+        
+        if( p->p_type == PT_LOAD &&
+            inAddress >= p->p_vaddr &&
+            inAddress < p->p_vaddr + p->p_filesz &&
+            p->p_offset + ( inAddress - p->p_vaddr ) < inElf->imageSize ) {
+            
+            return inElf->image + p->p_offset + ( inAddress - p->p_vaddr );
+            }
+        }
+    return NULL;
+    }
+
+
+
+static int compareFdeEntries( const void *inA, const void *inB ) {
+    const FdeEntry *a = (const FdeEntry *)inA;
+    const FdeEntry *b = (const FdeEntry *)inB;
+    
+    if( a->pcBegin < b->pcBegin ) {
+        return -1;
+        }
+    if( a->pcBegin > b->pcBegin ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+static void buildFdeTable( ElfFile *inElf ) {
+    EhSection ehFrame = { inElf->ehFrame, 
+                          inElf->ehFrame + inElf->ehFrameSize,
+                          inElf->ehFrameAddress };
+    
+    unsigned char *pos = inElf->ehFrame;
+    
+    while( pos != NULL && pos < ehFrame.end ) {
+        unsigned char *body;
+        unsigned char *next = readEhFrameEntryLength( pos, ehFrame.end, 
+                                                      &body );
+        if( next == NULL ) {
+            break;
+            }
+        
+        FdeInfo fde;
+        if( parseFde( &ehFrame, pos, &fde ) ) {
+            FdeEntry entry = { fde.pcBegin, 
+                               (unsigned long)( pos - inElf->ehFrame ) };
+            inElf->fdeTable.push_back( entry );
+            }
+        pos = next;
+        }
+    
+    if( inElf->fdeTable.size() > 0 ) {
+        qsort( inElf->fdeTable.getElementFast( 0 ), inElf->fdeTable.size(),
+               sizeof( FdeEntry ), compareFdeEntries );
+        }
+    }
+
+
+
+static void loadUnwindInfo( ElfFile *inElf ) {
+    inElf->unwindInfoLoaded = true;
+    
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inElf->image;
+    
+    unsigned char *hdr = NULL;
+    unsigned long hdrSize = 0;
+    
+    // sections, if they weren't stripped
+    ElfW(Shdr) *names = getElfSection( inElf, header->e_shstrndx );
+    
+    for( int i=1; names != NULL && i<header->e_shnum; i++ ) {
+        ElfW(Shdr) *section = getElfSection( inElf, i );
+        
+        if( section == NULL || section->sh_type == SHT_NOBITS ||
+            section->sh_name >= names->sh_size ||
+            section->sh_offset + section->sh_size > inElf->imageSize ) {
+            continue;
+            }
+        const char *name = 
+            (const char *)( inElf->image + names->sh_offset + 
+                            section->sh_name );
+        
+        if( strcmp( name, ".eh_frame" ) == 0 ) {
+            inElf->ehFrame = inElf->image + section->sh_offset;
+            inElf->ehFrameSize = section->sh_size;
+            inElf->ehFrameAddress = section->sh_addr;
+            }
+        else if( strcmp( name, ".eh_frame_hdr" ) == 0 ) {
+            hdr = inElf->image + section->sh_offset;
+            hdrSize = section->sh_size;
+            inElf->ehFrameHdrAddress = section->sh_addr;
+            }
+        }
+    
+    if( hdr == NULL &&
+        header->e_phoff + header->e_phnum * sizeof( ElfW(Phdr) ) <= 
+        inElf->imageSize ) {
+        // no section headers, but the loader finds it this way too
+        ElfW(Phdr) *phdrs = (ElfW(Phdr) *)( inElf->image + header->e_phoff );
+        
+        for( int i=0; i<header->e_phnum; i++ ) {
+            if( phdrs[i].p_type == PT_GNU_EH_FRAME ) {
+                hdr = getElfImageAddress( inElf, phdrs[i].p_vaddr );
+                hdrSize = phdrs[i].p_memsz;
+                inElf->ehFrameHdrAddress = phdrs[i].p_vaddr;
+                }
+            }
+        if( hdr != NULL && 
+            hdr + hdrSize > inElf->image + inElf->imageSize ) {
+            hdr = NULL;
+            }
+        }
+    
+    if( hdr != NULL && hdrSize >= 4 && hdr[0] == 1 ) {
+        EhSection hdrSection = { hdr, hdr + hdrSize, 
+                                 inElf->ehFrameHdrAddress };
+        
+        int ehFramePtrEncoding = hdr[1];
+        int countEncoding = hdr[2];
+        int tableEncoding = hdr[3];
+        
+        unsigned char *pos = &( hdr[4] );
+        unsigned long ehFramePtr;
+        unsigned long count;
+        
+        if( readEncodedPointer( &pos, &hdrSection, ehFramePtrEncoding,
+                                inElf->ehFrameHdrAddress, &ehFramePtr ) &&
+            readEncodedPointer( &pos, &hdrSection, countEncoding,
+                                inElf->ehFrameHdrAddress, &count ) ) {
+            
+            if( inElf->ehFrame == NULL ) {
+                inElf->ehFrame = getElfImageAddress( inElf, ehFramePtr );
+                inElf->ehFrameAddress = ehFramePtr;
+                
+                if( inElf->ehFrame != NULL ) {
+                    // no section size, run to the end of the image and
+                    // rely on the zero terminator
+                    inElf->ehFrameSize = 
+                        inElf->image + inElf->imageSize - inElf->ehFrame;
+                    }
+                }
+            
+            // the usual table is 4-byte offsets from the start of hdr
+            if( tableEncoding == ( DW_EH_PE_datarel | DW_EH_PE_sdata4 ) &&
+                pos + count * 8 <= hdrSection.end &&
+                ( (unsigned long)pos & 3 ) == 0 ) {
+                
+                inElf->searchTable = (int32_t *)pos;
+                inElf->searchTableSize = count;
+                }
+            }
+        }
+    
+    if( inElf->ehFrame != NULL && inElf->searchTable == NULL ) {
+        buildFdeTable( inElf );
+        }
+    }
+
+
+
+static char findFde( ElfFile *inElf, unsigned long inAddress,
+                     FdeInfo *outFde ) {
+    if( ! inElf->unwindInfoLoaded ) {
+        loadUnwindInfo( inElf );
+        }
+    if( inElf->ehFrame == NULL ) {
+        return false;
+        }
+    
+    EhSection ehFrame = { inElf->ehFrame, 
+                          inElf->ehFrame + inElf->ehFrameSize,
+                          inElf->ehFrameAddress };
+    
+    unsigned char *fdePos = NULL;
+    
+    if( inElf->searchTable != NULL ) {
+        int low = 0;
+        int high = inElf->searchTableSize - 1;
+        int found = -1;
+        
+        while( low <= high ) {
+            int mid = ( low + high ) / 2;
+            unsigned long start = 
+                inElf->ehFrameHdrAddress + 
+                (long)inElf->searchTable[ 2 * mid ];
+            
+            if( start <= inAddress ) {
+                found = mid;
+                low = mid + 1;
+                }
+            else {
+                high = mid - 1;
+                }
+            }
+        if( found == -1 ) {
+            return false;
+            }
+        unsigned long fdeAddress = 
+            inElf->ehFrameHdrAddress + 
+            (long)inElf->searchTable[ 2 * found + 1 ];
+        
+        if( fdeAddress < inElf->ehFrameAddress ||
+            fdeAddress >= inElf->ehFrameAddress + inElf->ehFrameSize ) {
+            return false;
+            }
+        fdePos = inElf->ehFrame + ( fdeAddress - inElf->ehFrameAddress );
+        }
+    else {
+        int low = 0;
+        int high = inElf->fdeTable.size() - 1;
+        int found = -1;
+        
+        while( low <= high ) {
+            int mid = ( low + high ) / 2;
+            
+            if( inElf->fdeTable.getElementFast( mid )->pcBegin <= 
+                inAddress ) {
+                found = mid;
+                low = mid + 1;
+                }
+            else {
+                high = mid - 1;
+                }
+            }
+        if( found == -1 ) {
+            return false;
+            }
+        fdePos = inElf->ehFrame + 
+            inElf->fdeTable.getElementFast( found )->fdeOffset;
+        }
+    
+    if( ! parseFde( &ehFrame, fdePos, outFde ) ) {
+        return false;
+        }
+    return ( inAddress >= outFde->pcBegin && inAddress < outFde->pcEnd );
+    }
+
+
+
+// register rules from the CFI program
+#define RULE_SAME_VALUE     0
+#define RULE_UNDEFINED      1
+#define RULE_OFFSET         2
+#define RULE_VAL_OFFSET     3
+#define RULE_REGISTER       4
+#define RULE_EXPRESSION     5
+#define RULE_VAL_EXPRESSION 6
+
+// how the CFA is computed
+#define CFA_REGISTER_OFFSET 0
+#define CFA_EXPRESSION      1
+
+
+typedef struct RegisterRule {
+        char type;
+        long value;
+        unsigned char *expression;
+        unsigned long expressionLength;
+    } RegisterRule;
+
+
+typedef struct CfiState {
+        char cfaType;
+        int cfaRegister;
+        long cfaOffset;
+        unsigned char *cfaExpression;
+        unsigned long cfaExpressionLength;
+        
+        RegisterRule rules[ NUM_DWARF_REGISTERS ];
+    } CfiState;
+
+
+// DW_CFA_remember_state nesting we can handle
+#define MAX_CFI_STATE_STACK 8
+
+
+
+static void setRegisterRule( CfiState *ioState, unsigned long inRegister,
+                             char inType, long inValue ) {
+    // ignore vector registers and such that we don't track
+    if( inRegister < NUM_DWARF_REGISTERS ) {
+        ioState->rules[ inRegister ].type = inType;
+        ioState->rules[ inRegister ].value = inValue;
+        }
+    }
+
+
+
+static void setRegisterRuleExpression( CfiState *ioState, 
+                                       unsigned long inRegister,
+                                       char inType,
+                                       unsigned char **ioPos, 
+                                       unsigned char *inEnd ) {
+    unsigned long length = readULEB128( ioPos, inEnd );
+    
+    if( inRegister < NUM_DWARF_REGISTERS ) {
+        RegisterRule *rule = &( ioState->rules[ inRegister ] );
+        rule->type = inType;
+        rule->expression = *ioPos;
+        rule->expressionLength = length;
+        }
+    *ioPos += length;
+    }
+
+
+
+// runs CFI instructions until the location passes inTarget
+// returns false on malformed or unsupported instructions
+static char runCfiProgram( unsigned char *inPos, unsigned char *inEnd,
+                           CieInfo *inCie, EhSection *inEhFrame,
+                           unsigned long inLocation, unsigned long inTarget,
+                           CfiState *ioState, CfiState *inInitialState ) {
+    CfiState stateStack[ MAX_CFI_STATE_STACK ];
+    int stateStackSize = 0;
+    
+    unsigned char *pos = inPos;
+    unsigned long location = inLocation;
+    
+    while( pos < inEnd ) {
+        unsigned char op = *pos;
+        pos++;
+        
+        int highBits = op & 0xc0;
+        int lowBits = op & 0x3f;
+        
+        unsigned long reg;
+        unsigned long delta;
+        
+        if( highBits == 0x40 ) {
+            // DW_CFA_advance_loc
+            location += lowBits * inCie->codeAlign;
+            if( location > inTarget ) {
+                return true;
+                }
+            continue;
+            }
+        else if( highBits == 0x80 ) {
+            // DW_CFA_offset
+            long offset = readULEB128( &pos, inEnd ) * inCie->dataAlign;
+            setRegisterRule( ioState, lowBits, RULE_OFFSET, offset );
+            continue;
+            }
+        else if( highBits == 0xc0 ) {
+            // DW_CFA_restore
+            if( inInitialState != NULL && lowBits < NUM_DWARF_REGISTERS ) {
+                ioState->rules[ lowBits ] = inInitialState->rules[ lowBits ];
+                }
+            continue;
+            }
+        
+        switch( op ) {
+            case 0x00:
+                // DW_CFA_nop
+                break;
+            case 0x01: {
+                // DW_CFA_set_loc
+                unsigned long newLocation;
+                if( ! readEncodedPointer( &pos, inEhFrame, 
+                                          inCie->fdeEncoding, 0,
+                                          &newLocation ) ) {
+                    return false;
+                    }
+                location = newLocation;
+                if( location > inTarget ) {
+                    return true;
+                    }
+                break;
+                }
+            case 0x02:
+            case 0x03:
+            case 0x04:
+                // DW_CFA_advance_loc1, 2, 4
+                if( ! readFixed( &pos, inEnd, 1 << ( op - 0x02 ), 
+                                 &delta ) ) {
+                    return false;
+                    }
+                location += delta * inCie->codeAlign;
+                if( location > inTarget ) {
+                    return true;
+                    }
+                break;
+            case 0x05: {
+                // DW_CFA_offset_extended
+                reg = readULEB128( &pos, inEnd );
+                long offset = readULEB128( &pos, inEnd ) * inCie->dataAlign;
+                setRegisterRule( ioState, reg, RULE_OFFSET, offset );
+                break;
+                }
+            case 0x06:
+                // DW_CFA_restore_extended
+                reg = readULEB128( &pos, inEnd );
+                if( inInitialState != NULL && reg < NUM_DWARF_REGISTERS ) {
+                    ioState->rules[ reg ] = inInitialState->rules[ reg ];
+                    }
+                break;
+            case 0x07:
+                // DW_CFA_undefined
+                reg = readULEB128( &pos, inEnd );
+                setRegisterRule( ioState, reg, RULE_UNDEFINED, 0 );
+                break;
+            case 0x08:
+                // DW_CFA_same_value
+                reg = readULEB128( &pos, inEnd );
+                setRegisterRule( ioState, reg, RULE_SAME_VALUE, 0 );
+                break;
+            case 0x09: {
+                // DW_CFA_register
+                reg = readULEB128( &pos, inEnd );
+                long otherReg = readULEB128( &pos, inEnd );
+                setRegisterRule( ioState, reg, RULE_REGISTER, otherReg );
+                break;
+                }
+            case 0x0a:
+                // DW_CFA_remember_state
+                if( stateStackSize >= MAX_CFI_STATE_STACK ) {
+                    return false;
+                    }
+                stateStack[ stateStackSize ] = *ioState;
+                stateStackSize++;
+                break;
+            case 0x0b:
+                // DW_CFA_restore_state
+                if( stateStackSize == 0 ) {
+                    return false;
+                    }
+                stateStackSize--;
+                
+                // includes the CFA rule, which GCC relies on around
+                // epilogues in the middle of a function
+                *ioState = stateStack[ stateStackSize ];
+                break;
+            case 0x0c:
+                // DW_CFA_def_cfa
+                ioState->cfaType = CFA_REGISTER_OFFSET;
+                ioState->cfaRegister = readULEB128( &pos, inEnd );
+                ioState->cfaOffset = readULEB128( &pos, inEnd );
+                break;
+            case 0x0d:
+                // DW_CFA_def_cfa_register
+                ioState->cfaType = CFA_REGISTER_OFFSET;
+                ioState->cfaRegister = readULEB128( &pos, inEnd );
+                break;
+            case 0x0e:
+                // DW_CFA_def_cfa_offset
+                ioState->cfaOffset = readULEB128( &pos, inEnd );
+                break;
+            case 0x0f:
+                // DW_CFA_def_cfa_expression
+                ioState->cfaType = CFA_EXPRESSION;
+                ioState->cfaExpressionLength = readULEB128( &pos, inEnd );
+                ioState->cfaExpression = pos;
+                pos += ioState->cfaExpressionLength;
+                break;
+            case 0x10:
+                // DW_CFA_expression
+                reg = readULEB128( &pos, inEnd );
+                setRegisterRuleExpression( ioState, reg, RULE_EXPRESSION,
+                                           &pos, inEnd );
+                break;
+            case 0x11: {
+                // DW_CFA_offset_extended_sf
+                reg = readULEB128( &pos, inEnd );
+                long offset = readSLEB128( &pos, inEnd ) * inCie->dataAlign;
+                setRegisterRule( ioState, reg, RULE_OFFSET, offset );
+                break;
+                }
+            case 0x12:
+                // DW_CFA_def_cfa_sf
+                ioState->cfaType = CFA_REGISTER_OFFSET;
+                ioState->cfaRegister = readULEB128( &pos, inEnd );
+                ioState->cfaOffset = 
+                    readSLEB128( &pos, inEnd ) * inCie->dataAlign;
+                break;
+            case 0x13:
+                // DW_CFA_def_cfa_offset_sf
+                ioState->cfaOffset = 
+                    readSLEB128( &pos, inEnd ) * inCie->dataAlign;
+                break;
+            case 0x14: {
+                // DW_CFA_val_offset
+                reg = readULEB128( &pos, inEnd );
+                long offset = readULEB128( &pos, inEnd ) * inCie->dataAlign;
+                setRegisterRule( ioState, reg, RULE_VAL_OFFSET, offset );
+                break;
+                }
+            case 0x15: {
+                // DW_CFA_val_offset_sf
+                reg = readULEB128( &pos, inEnd );
+                long offset = readSLEB128( &pos, inEnd ) * inCie->dataAlign;
+                setRegisterRule( ioState, reg, RULE_VAL_OFFSET, offset );
+                break;
+                }
+            case 0x16:
+                // DW_CFA_val_expression
+                reg = readULEB128( &pos, inEnd );
+                setRegisterRuleExpression( ioState, reg, RULE_VAL_EXPRESSION,
+                                           &pos, inEnd );
+                break;
+            case 0x2d:
+                // DW_CFA_GNU_window_save, or on aarch64 
+                // DW_CFA_AARCH64_negate_ra_state, nothing for us to do
+                break;
+            case 0x2e:
+                // DW_CFA_GNU_args_size
+                readULEB128( &pos, inEnd );
+                break;
+            case 0x2f: {
+                // DW_CFA_GNU_negative_offset_extended
+                reg = readULEB128( &pos, inEnd );
+                long offset = 
+                    - (long)readULEB128( &pos, inEnd ) * inCie->dataAlign;
+                setRegisterRule( ioState, reg, RULE_OFFSET, offset );
+                break;
+                }
+            default:
+                return false;
+            }
+        }
+    return true;
+    }
+
+
+
+// evaluation stack depth for DWARF expressions
+#define MAX_DWARF_STACK 64
+
+
+// evaluates a DWARF location expression against the registers of
+// the frame being unwound
+static char evaluateDwarfExpression( unsigned char *inExpression, 
+                                     unsigned long inLength,
+                                     NativeRegisters *inRegs,
+                                     StackCopy *inStackCopy,
+                                     unsigned long inLoadBias,
+                                     char inPushInitial,
+                                     unsigned long inInitial,
+                                     unsigned long *outResult ) {
+    unsigned long stack[ MAX_DWARF_STACK ];
+    int size = 0;
+    
+    if( inPushInitial ) {
+        stack[ size ] = inInitial;
+        size++;
+        }
+    
+    unsigned char *pos = inExpression;
+    unsigned char *end = inExpression + inLength;
+    
+    // ops that need more stack than is there fail here
+    #define NEED_STACK( n ) if( size < (n) ) { return false; }
+    #define PUSH( v ) if( size >= MAX_DWARF_STACK ) { return false; } \
+                      stack[ size ] = (v); size++;
+    
+    while( pos < end ) {
+        unsigned char op = *pos;
+        pos++;
+        
+        unsigned long value;
+        
+        if( op >= 0x30 && op <= 0x4f ) {
+            // DW_OP_lit0 - 31
+            PUSH( (unsigned long)( op - 0x30 ) );
+            continue;
+            }
+        if( op >= 0x50 && op <= 0x6f ) {
+            // DW_OP_reg0 - 31
+            if( op - 0x50 >= NUM_DWARF_REGISTERS ) {
+                return false;
+                }
+            PUSH( inRegs->regs[ op - 0x50 ] );
+            continue;
+            }
+        if( op >= 0x70 && op <= 0x8f ) {
+            // DW_OP_breg0 - 31
+            long offset = readSLEB128( &pos, end );
+            if( op - 0x70 >= NUM_DWARF_REGISTERS ) {
+                return false;
+                }
+            PUSH( inRegs->regs[ op - 0x70 ] + offset );
+            continue;
+            }
+        
+        switch( op ) {
+            case 0x03:
+                // DW_OP_addr
+                if( ! readFixed( &pos, end, sizeof( long ), &value ) ) {
+                    return false;
+                    }
+                PUSH( value + inLoadBias );
+                break;
+            case 0x06:
+                // DW_OP_deref
+                NEED_STACK( 1 );
+                if( ! readUnwindMemory( inStackCopy, stack[ size - 1 ], 
+                                        &value, sizeof( long ) ) ) {
+                    return false;
+                    }
+                stack[ size - 1 ] = value;
+                break;
+            case 0x08:
+            case 0x0a:
+            case 0x0c:
+            case 0x0e: {
+                // DW_OP_const1u, 2u, 4u, 8u
+                if( ! readFixed( &pos, end, 1 << ( ( op - 0x08 ) / 2 ), 
+                                 &value ) ) {
+                    return false;
+                    }
+                PUSH( value );
+                break;
+                }
+            case 0x09:
+                // DW_OP_const1s
+                if( ! readFixed( &pos, end, 1, &value ) ) {
+                    return false;
+                    }
+                PUSH( (long)(int8_t)value );
+                break;
+            case 0x0b:
+                // DW_OP_const2s
+                if( ! readFixed( &pos, end, 2, &value ) ) {
+                    return false;
+                    }
+                PUSH( (long)(int16_t)value );
+                break;
+            case 0x0d:
+                // DW_OP_const4s
+                if( ! readFixed( &pos, end, 4, &value ) ) {
+                    return false;
+                    }
+                PUSH( (long)(int32_t)value );
+                break;
+            case 0x0f:
+                // DW_OP_const8s
+                if( ! readFixed( &pos, end, 8, &value ) ) {
+                    return false;
+                    }
+                PUSH( value );
+                break;
+            case 0x10:
+                // DW_OP_constu
+                PUSH( readULEB128( &pos, end ) );
+                break;
+            case 0x11:
+                // DW_OP_consts
+                PUSH( readSLEB128( &pos, end ) );
+                break;
+            case 0x12:
+                // DW_OP_dup
+                NEED_STACK( 1 );
+                PUSH( stack[ size - 1 ] );
+                break;
+            case 0x13:
+                // DW_OP_drop
+                NEED_STACK( 1 );
+                size--;
+                break;
+            case 0x14:
+                // DW_OP_over
+                NEED_STACK( 2 );
+                PUSH( stack[ size - 2 ] );
+                break;
+            case 0x15: {
+                // DW_OP_pick
+                unsigned int index = *pos;
+                pos++;
+                NEED_STACK( (int)index + 1 );
+                PUSH( stack[ size - 1 - index ] );
+                break;
+                }
+            case 0x16: {
+                // DW_OP_swap
+                NEED_STACK( 2 );
+                unsigned long temp = stack[ size - 1 ];
+                stack[ size - 1 ] = stack[ size - 2 ];
+                stack[ size - 2 ] = temp;
+                break;
+                }
+            case 0x17: {
+                // DW_OP_rot
+                NEED_STACK( 3 );
+                unsigned long top = stack[ size - 1 ];
+                stack[ size - 1 ] = stack[ size - 2 ];
+                stack[ size - 2 ] = stack[ size - 3 ];
+                stack[ size - 3 ] = top;
+                break;
+                }
+            case 0x19:
+                // DW_OP_abs
+                NEED_STACK( 1 );
+                if( (long)stack[ size - 1 ] < 0 ) {
+                    stack[ size - 1 ] = - (long)stack[ size - 1 ];
+                    }
+                break;
+            case 0x1f:
+                // DW_OP_neg
+                NEED_STACK( 1 );
+                stack[ size - 1 ] = - (long)stack[ size - 1 ];
+                break;
+            case 0x20:
+                // DW_OP_not
+                NEED_STACK( 1 );
+                stack[ size - 1 ] = ~stack[ size - 1 ];
+                break;
+            case 0x23:
+                // DW_OP_plus_uconst
+                NEED_STACK( 1 );
+                stack[ size - 1 ] += readULEB128( &pos, end );
+                break;
+            case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e:
+            case 0x21: case 0x22: case 0x24: case 0x25: case 0x26:
+            case 0x27: case 0x29: case 0x2a: case 0x2b: case 0x2c:
+            case 0x2d: case 0x2e: {
+                // binary operators
+                NEED_STACK( 2 );
+                unsigned long b = stack[ size - 1 ];
+                unsigned long a = stack[ size - 2 ];
+                size--;
+                
+                unsigned long result = 0;
+                
+                switch( op ) {
+                    case 0x1a: result = a & b; break;
+                    case 0x1b:
+                        if( b == 0 ) {
+                            return false;
+                            }
+                        result = (long)a / (long)b;
+                        break;
+                    case 0x1c: result = a - b; break;
+                    case 0x1d:
+                        if( b == 0 ) {
+                            return false;
+                            }
+                        result = a % b;
+                        break;
+                    case 0x1e: result = a * b; break;
+                    case 0x21: result = a | b; break;
+                    case 0x22: result = a + b; break;
+                    case 0x24: result = a << b; break;
+                    case 0x25: result = a >> b; break;
+                    case 0x26: result = (long)a >> b; break;
+                    case 0x27: result = a ^ b; break;
+                    case 0x29: result = ( a == b ); break;
+                    case 0x2a: result = ( (long)a >= (long)b ); break;
+                    case 0x2b: result = ( (long)a > (long)b ); break;
+                    case 0x2c: result = ( (long)a <= (long)b ); break;
+                    case 0x2d: result = ( (long)a < (long)b ); break;
+                    case 0x2e: result = ( a != b ); break;
+                    }
+                stack[ size - 1 ] = result;
+                break;
+                }
+            case 0x28: {
+                // DW_OP_bra
+                NEED_STACK( 1 );
+                if( ! readFixed( &pos, end, 2, &value ) ) {
+                    return false;
+                    }
+                size--;
+                if( stack[ size ] != 0 ) {
+                    pos += (int16_t)value;
+                    }
+                break;
+                }
+            case 0x2f:
+                // DW_OP_skip
+                if( ! readFixed( &pos, end, 2, &value ) ) {
+                    return false;
+                    }
+                pos += (int16_t)value;
+                break;
+            case 0x90: {
+                // DW_OP_regx
+                unsigned long reg = readULEB128( &pos, end );
+                if( reg >= NUM_DWARF_REGISTERS ) {
+                    return false;
+                    }
+                PUSH( inRegs->regs[ reg ] );
+                break;
+                }
+            case 0x92: {
+                // DW_OP_bregx
+                unsigned long reg = readULEB128( &pos, end );
+                long offset = readSLEB128( &pos, end );
+                if( reg >= NUM_DWARF_REGISTERS ) {
+                    return false;
+                    }
+                PUSH( inRegs->regs[ reg ] + offset );
+                break;
+                }
+            case 0x94: {
+                // DW_OP_deref_size
+                NEED_STACK( 1 );
+                int numBytes = *pos;
+                pos++;
+                if( numBytes < 1 || numBytes > (int)sizeof( long ) ) {
+                    return false;
+                    }
+                value = 0;
+                if( ! readUnwindMemory( inStackCopy, stack[ size - 1 ], 
+                                        &value, numBytes ) ) {
+                    return false;
+                    }
+                stack[ size - 1 ] = value;
+                break;
+                }
+            case 0x96:
+                // DW_OP_nop
+                break;
+            default:
+                return false;
+            }
+        }
+    
+    #undef NEED_STACK
+    #undef PUSH
+    
+    if( size == 0 ) {
+        return false;
+        }
+    *outResult = stack[ size - 1 ];
+    return true;
+    }
+
+
+
+#if defined(__x86_64__)
+
+// the rt_sigreturn trampoline:  mov $15, %rax; syscall
+static const unsigned char sigreturnCode[] = 
+    { 0x48, 0xc7, 0xc0, 0x0f, 0x00, 0x00, 0x00, 0x0f, 0x05 };
+
+
+// C libraries without CFI for their signal trampoline (musl, etc.)
+// leave us in a frame with no FDE
+// the kernel's ucontext sits right at the stack pointer there
+static char unwindSignalTrampoline( NativeRegisters *ioRegs, 
+                                    StackCopy *inStackCopy ) {
+    unsigned char code[ sizeof( sigreturnCode ) ];
+    
+    if( ! readNativeMemory( ioRegs->pc, code, sizeof( code ) ) ||
+        memcmp( code, sigreturnCode, sizeof( code ) ) != 0 ) {
+        return false;
+        }
+    
+    unsigned long gregs[ NGREG ];
+    
+    if( ! readUnwindMemory( inStackCopy, 
+                            ioRegs->regs[ DWARF_SP_REGISTER ] +
+                            offsetof( ucontext_t, uc_mcontext.gregs ),
+                            gregs, sizeof( gregs ) ) ) {
+        return false;
+        }
+    
+    unsigned long *r = ioRegs->regs;
+    r[0] = gregs[ REG_RAX ];
+    r[1] = gregs[ REG_RDX ];
+    r[2] = gregs[ REG_RCX ];
+    r[3] = gregs[ REG_RBX ];
+    r[4] = gregs[ REG_RSI ];
+    r[5] = gregs[ REG_RDI ];
+    r[6] = gregs[ REG_RBP ];
+    r[7] = gregs[ REG_RSP ];
+    r[8] = gregs[ REG_R8 ];
+    r[9] = gregs[ REG_R9 ];
+    r[10] = gregs[ REG_R10 ];
+    r[11] = gregs[ REG_R11 ];
+    r[12] = gregs[ REG_R12 ];
+    r[13] = gregs[ REG_R13 ];
+    r[14] = gregs[ REG_R14 ];
+    r[15] = gregs[ REG_R15 ];
+    r[16] = gregs[ REG_RIP ];
+    ioRegs->pc = gregs[ REG_RIP ];
+    
+    return true;
+    }
+
+#else
+
+static char unwindSignalTrampoline( NativeRegisters *ioRegs, 
+                                    StackCopy *inStackCopy ) {
+    return false;
+    }
+
+#endif
+
+
+
+// no CFI for this frame, so hope it has a frame pointer
+static char unwindFramePointer( NativeRegisters *ioRegs, 
+                                StackCopy *inStackCopy ) {
+    unsigned long fp = ioRegs->regs[ DWARF_FP_REGISTER ];
+    
+    // must be up the stack from where we are now
+    if( fp == 0 || fp < ioRegs->regs[ DWARF_SP_REGISTER ] ) {
+        return false;
+        }
+    
+    // saved caller frame pointer, then return address
+    unsigned long frame[2];
+    
+    if( ! readUnwindMemory( inStackCopy, fp, frame, sizeof( frame ) ) ) {
+        return false;
+        }
+    
+    ioRegs->regs[ DWARF_FP_REGISTER ] = frame[0];
+    ioRegs->regs[ DWARF_SP_REGISTER ] = fp + sizeof( frame );
+    ioRegs->pc = frame[1];
+    
+    return true;
+    }
+
+
+
+static char getRuleValue( RegisterRule *inRule, int inRegister,
+                          unsigned long inCFA, NativeRegisters *inRegs,
+                          StackCopy *inStackCopy, unsigned long inLoadBias,
+                          unsigned long *outValue ) {
+    unsigned long address;
+    
+    switch( inRule->type ) {
+        case RULE_SAME_VALUE:
+            *outValue = inRegs->regs[ inRegister ];
+            return true;
+        case RULE_OFFSET:
+            return readUnwindMemory( inStackCopy, inCFA + inRule->value,
+                                     outValue, sizeof( long ) );
+        case RULE_VAL_OFFSET:
+            *outValue = inCFA + inRule->value;
+            return true;
+        case RULE_REGISTER:
+            if( inRule->value < 0 || inRule->value >= NUM_DWARF_REGISTERS ) {
+                return false;
+                }
+            *outValue = inRegs->regs[ inRule->value ];
+            return true;
+        case RULE_EXPRESSION:
+            if( ! evaluateDwarfExpression( inRule->expression,
+                                           inRule->expressionLength,
+                                           inRegs, inStackCopy, inLoadBias,
+                                           true, inCFA, &address ) ) {
+                return false;
+                }
+            return readUnwindMemory( inStackCopy, address, outValue,
+                                     sizeof( long ) );
+        case RULE_VAL_EXPRESSION:
+            return evaluateDwarfExpression( inRule->expression,
+                                            inRule->expressionLength,
+                                            inRegs, inStackCopy, inLoadBias,
+                                            true, inCFA, outValue );
+        default:
+            return false;
+        }
+    }
+
+
+
+// unwinds ioRegs from a frame to its caller's frame
+// ioExactPC is true if ioRegs->pc is the exact address of the next
+// instruction to run (the top frame, or a frame interrupted by a signal)
+// rather than a return address, and is updated for the caller
+// returns false when there are no more frames
+static char unwindNativeFrame( NativeRegisters *ioRegs, char *ioExactPC,
+                               StackCopy *inStackCopy ) {
+    
+    // a return address points after the call, which may be past the
+    // end of the calling function's FDE
+    unsigned long lookupPC = *ioExactPC ? ioRegs->pc : ioRegs->pc - 1;
+    
+    MemoryRegion *r = findCodeRegion( lookupPC );
+    
+    FdeInfo fde;
+    
+    if( r == NULL || r->elf == NULL ||
+        ! findFde( r->elf, lookupPC - r->loadBias, &fde ) ) {
+        
+        if( unwindSignalTrampoline( ioRegs, inStackCopy ) ) {
+            *ioExactPC = true;
+            return true;
+            }
+        *ioExactPC = false;
+        return unwindFramePointer( ioRegs, inStackCopy );
+        }
+    
+    EhSection ehFrame = { r->elf->ehFrame, 
+                          r->elf->ehFrame + r->elf->ehFrameSize,
+                          r->elf->ehFrameAddress };
+    
+    CfiState state;
+    memset( &state, 0, sizeof( state ) );
+    state.cfaRegister = DWARF_SP_REGISTER;
+    
+    // registers without rules keep their values
+    for( int i=0; i<NUM_DWARF_REGISTERS; i++ ) {
+        state.rules[i].type = RULE_SAME_VALUE;
+        }
+    
+    if( ! runCfiProgram( fde.cie.instructions, fde.cie.instructionsEnd,
+                         &( fde.cie ), &ehFrame, fde.pcBegin, 
+                         (unsigned long)-1, &state, NULL ) ) {
+        return false;
+        }
+    CfiState initialState = state;
+    
+    if( ! runCfiProgram( fde.instructions, fde.instructionsEnd,
+                         &( fde.cie ), &ehFrame, fde.pcBegin, 
+                         lookupPC - r->loadBias, &state, &initialState ) ) {
+        return false;
+        }
+    
+    unsigned long cfa;
+    
+    if( state.cfaType == CFA_EXPRESSION ) {
+        if( ! evaluateDwarfExpression( state.cfaExpression, 
+                                       state.cfaExpressionLength,
+                                       ioRegs, inStackCopy, r->loadBias,
+                                       false, 0, &cfa ) ) {
+            return false;
+            }
+        }
+    else {
+        if( state.cfaRegister < 0 || 
+            state.cfaRegister >= NUM_DWARF_REGISTERS ) {
+            return false;
+            }
+        cfa = ioRegs->regs[ state.cfaRegister ] + state.cfaOffset;
+        }
+    
+    int raRegister = fde.cie.returnAddressRegister;
+    
+    if( raRegister < 0 || raRegister >= NUM_DWARF_REGISTERS ||
+        state.rules[ raRegister ].type == RULE_UNDEFINED ) {
+        // outermost frame, like _start
+        return false;
+        }
+    
+    NativeRegisters caller = *ioRegs;
+    
+    // the CFA is the caller's stack pointer, unless a rule says otherwise
+    caller.regs[ DWARF_SP_REGISTER ] = cfa;
+    
+    for( int i=0; i<NUM_DWARF_REGISTERS; i++ ) {
+        RegisterRule *rule = &( state.rules[i] );
+        
+        if( rule->type == RULE_SAME_VALUE ) {
+            continue;
+            }
+        if( rule->type == RULE_UNDEFINED ) {
+            caller.regs[i] = 0;
+            continue;
+            }
+        if( ! getRuleValue( rule, i, cfa, ioRegs, inStackCopy, r->loadBias,
+                            &( caller.regs[i] ) ) ) {
+            return false;
+            }
+        }
+    
+    caller.pc = caller.regs[ raRegister ];
+
+    // past a signal trampoline, the PC is where the signal interrupted
+    *ioExactPC = fde.cie.isSignalFrame;
+    
+    *ioRegs = caller;
+    return true;
+    }
+
+
+
+// fills outPCs with the PC of each frame, innermost first
+// outIsCaller[i] is true if outPCs[i] is a return address
+static int unwindNativeStack( NativeRegisters *inRegs, StackCopy *inStackCopy,
+                              unsigned long *outPCs, char *outIsCaller,
+                              int inMaxDepth ) {
+    int numFrames = 0;
+    
+    NativeRegisters regs = *inRegs;
+    char exactPC = true;
+    
+    while( numFrames < inMaxDepth && regs.pc != 0 ) {
+        outPCs[ numFrames ] = regs.pc;
+        outIsCaller[ numFrames ] = ! exactPC;
+        numFrames++;
+        
+        unsigned long lastPC = regs.pc;
+        unsigned long lastSP = regs.regs[ DWARF_SP_REGISTER ];
+        
+        char wasExact = exactPC;
+        
+        if( ! unwindNativeFrame( &regs, &exactPC, inStackCopy ) ) {
+            break;
+            }
+        
+        unsigned long sp = regs.regs[ DWARF_SP_REGISTER ];
+        
+        // the stack grows down, so callers must be higher up, but a
+        // signal frame can switch stacks
+        if( ( sp < lastSP && ! exactPC ) ||
+            ( sp == lastSP && regs.pc == lastPC && wasExact == exactPC ) ) {
+            break;
+            }
+        
+        // a frame pointer guess that led nowhere
+        if( findCodeRegion( exactPC ? regs.pc : regs.pc - 1 ) == NULL ) {
+            break;
+            }
+        }
+    
+    return numFrames;
+    }
+
+
+
+
+// target must be stopped
+// unwinds every thread and hands the frames to the worker
+// returns the number of stacks captured
+static int captureNativeStacks() {
+    int numStacks = 0;
+    
+    for( int t=0; t<nativeThreads.size(); t++ ) {
+        NativeThread *thread = nativeThreads.getElementFast( t );
+        
+        nativeCurrentTID = thread->tid;
+        
+        NativeRegisters regs;
+        
+        if( ! getNativeRegisters( thread->tid, &regs ) ) {
+            continue;
+            }
+        
+        copyNativeStack( regs.regs[ DWARF_SP_REGISTER ], &nativeStackCopy );
+        
+        if( nativeFramePCs == NULL ) {
+            nativeFramePCs = new unsigned long[ maxStackDepth + 1 ];
+            nativeFrameIsCaller = new char[ maxStackDepth + 1 ];
+            }
+        
+        int numFrames = unwindNativeStack( &regs, &nativeStackCopy, 
+                                           nativeFramePCs, 
+                                           nativeFrameIsCaller,
+                                           maxStackDepth + 1 );
+        
+        if( time( NULL ) != thread->nameReadTime ) {
+            readNativeThreadName( thread );
+            }
+        
+        // the one past the limit is replaced by a [truncated] frame
+        int numPCs = numFrames;
+        if( numPCs > maxStackDepth ) {
+            numPCs = maxStackDepth;
+            }
+        
+        StackFrame *frames = (StackFrame *)beginStackRecord( 
+            NATIVE_STACK_RECORD, thread->tid, thread->name,
+            numFrames * sizeof( StackFrame ) );
+        
+        if( frames == NULL ) {
+            continue;
+            }
+        
+        // names are looked up after sampling, by resolveDeferredSymbols
+        for( int i=0; i<numPCs; i++ ) {
+            StackFrame *f = &( frames[i] );
+            f->address = (void *)nativeFramePCs[i];
+            f->funcNameID = 0;
+            f->fileNameID = 0;
+            f->lineNum = -1;
+            f->isCaller = nativeFrameIsCaller[i];
+            }
+        
+        if( numFrames > numPCs ) {
+            setTruncatedFrame( &( frames[ numPCs ] ) );
+            }
+        
+        commitRingRecord();
+        numStacks++;
+        }
+    
+    return numStacks;
+    }
+
+
+
+
+// **************************************
+// DWARF line tables, split debug files, and the symbol cache
+
+// source lines come from .debug_line, in the file itself or in a
+// separate debug file found by build ID or .gnu_debuglink
+// the sorted symbol and line tables we end up with are written to a 
+// cache file named by build ID, so the next session against the same
+// build just maps that file instead of parsing anything
+
+
+
+// returns the section named inName if its contents are in the image
+// we can't read compressed debug sections (no zlib), so those are
+// treated as missing
+static ElfW(Shdr) *findElfSection( ElfFile *inElf, const char *inName ) {
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inElf->image;
+    ElfW(Shdr) *names = getElfSection( inElf, header->e_shstrndx );
+    
+    if( names == NULL || 
+        names->sh_offset + names->sh_size > inElf->imageSize ) {
+        return NULL;
+        }
+    
+    for( int i=1; i<header->e_shnum; i++ ) {
+        ElfW(Shdr) *section = getElfSection( inElf, i );
+        
+        if( section == NULL || section->sh_name >= names->sh_size ) {
+            continue;
+            }
+        const char *name = 
+            (const char *)( inElf->image + names->sh_offset + 
+                            section->sh_name );
+        
+        if( strcmp( name, inName ) != 0 ) {
+            continue;
+            }
+        if( section->sh_type == SHT_NOBITS ||
+            ( section->sh_flags & SHF_COMPRESSED ) ||
+            section->sh_offset + section->sh_size > inElf->imageSize ) {
+            return NULL;
+            }
+        return section;
+        }
+    return NULL;
+    }
+
+
+
+// finds the NT_GNU_BUILD_ID note and returns it in hex, or NULL
+static char *readBuildID( ElfFile *inElf ) {
+    ElfW(Ehdr) *header = (ElfW(Ehdr) *)inElf->image;
+    
+    if( header->e_phoff + header->e_phnum * sizeof( ElfW(Phdr) ) >
+        inElf->imageSize ) {
+        return NULL;
+        }
+    ElfW(Phdr) *phdrs = (ElfW(Phdr) *)( inElf->image + header->e_phoff );
+    
+    for( int i=0; i<header->e_phnum; i++ ) {
+        if( phdrs[i].p_type != PT_NOTE ||
+            phdrs[i].p_offset + phdrs[i].p_filesz > inElf->imageSize ) {
+            continue;
+            }
+        unsigned char *pos = inElf->image + phdrs[i].p_offset;
+        unsigned char *end = pos + phdrs[i].p_filesz;
+        
+        while( pos + sizeof( ElfW(Nhdr) ) <= end ) {
+            ElfW(Nhdr) *note = (ElfW(Nhdr) *)pos;
+            
+            unsigned char *name = pos + sizeof( ElfW(Nhdr) );
+            unsigned char *desc = name + ( ( note->n_namesz + 3 ) & ~3 );
+            unsigned char *next = desc + ( ( note->n_descsz + 3 ) & ~3 );
+            
+            if( next > end ) {
+                break;
+                }
+            
+            if( note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+                memcmp( name, "GNU", 4 ) == 0 && note->n_descsz > 0 ) {
+                
+                char *id = new char[ note->n_descsz * 2 + 1 ];
+                
+                for( unsigned int b=0; b<note->n_descsz; b++ ) {
+                    sprintf( &( id[ b * 2 ] ), "%02x", desc[b] );
+                    }
+                return id;
+                }
+            pos = next;
+            }
+        }
+    return NULL;
+    }
+
+
+
+static ElfFile *getDebugElfFile( const char *inPath ) {
+    struct stat fileStat;
+    
+    if( stat( inPath, &fileStat ) != 0 ) {
+        return NULL;
+        }
+    
+    // the native sampling thread may be adding to elfFiles
+    symbolTablesLock.lock();
+    ElfFile *e = getElfFile( inPath );
+    symbolTablesLock.unlock();
+    
+    if( e->image == NULL ) {
+        return NULL;
+        }
+    return e;
+    }
+
+
+
+// looks in the places GDB does for a separate debug info file
+static ElfFile *findDebugFile( ElfFile *inElf ) {
+    ElfFile *debugFile = NULL;
+    
+    if( inElf->buildID != NULL && strlen( inElf->buildID ) > 2 ) {
+        char *path = autoSprintf( "/usr/lib/debug/.build-id/%.2s/%s.debug",
+                                  inElf->buildID, &( inElf->buildID[2] ) );
+        debugFile = getDebugElfFile( path );
+        delete [] path;
+        
+        if( debugFile != NULL ) {
+            return debugFile;
+            }
+        }
+    
+    ElfW(Shdr) *link = findElfSection( inElf, ".gnu_debuglink" );
+    
+    if( link == NULL || link->sh_size == 0 ) {
+        return NULL;
+        }
+    const char *linkName = (const char *)( inElf->image + link->sh_offset );
+    
+    if( strnlen( linkName, link->sh_size ) == link->sh_size ) {
+        return NULL;
+        }
+    
+    char *dir = stringDuplicate( inElf->path );
+    char *lastSlash = strrchr( dir, '/' );
+    if( lastSlash != NULL ) {
+        lastSlash[0] = '\0';
+        }
+    
+    const char *formats[3] = { "%s/%s", "%s/.debug/%s", 
+                               "/usr/lib/debug%s/%s" };
+    
+    for( int i=0; i<3 && debugFile == NULL; i++ ) {
+        char *path = autoSprintf( formats[i], dir, linkName );
+        
+        // the link can name the file itself
+        if( strcmp( path, inElf->path ) != 0 ) {
+            debugFile = getDebugElfFile( path );
+            }
+        delete [] path;
+        }
+    delete [] dir;
+    
+    return debugFile;
+    }
+
+
+
+// string sections that DWARF 5 line table headers point into
+typedef struct DwarfStrings {
+        const char *debugStr;
+        unsigned long debugStrSize;
+        const char *lineStr;
+        unsigned long lineStrSize;
+    } DwarfStrings;
+
+
+// DW_LNCT and DW_FORM values used by DWARF 5 line table headers
+#define DW_LNCT_path            0x1
+#define DW_LNCT_directory_index 0x2
+
+#define DW_FORM_block2      0x03
+#define DW_FORM_block4      0x04
+#define DW_FORM_data2       0x05
+#define DW_FORM_data4       0x06
+#define DW_FORM_data8       0x07
+#define DW_FORM_string      0x08
+#define DW_FORM_block       0x09
+#define DW_FORM_block1      0x0a
+#define DW_FORM_data1       0x0b
+#define DW_FORM_sdata       0x0d
+#define DW_FORM_strp        0x0e
+#define DW_FORM_udata       0x0f
+#define DW_FORM_data16      0x1e
+#define DW_FORM_line_strp   0x1f
+
+
+
+static const char *getDwarfString( const char *inSection, 
+                                   unsigned long inSize,
+                                   unsigned long inOffset ) {
+    if( inSection == NULL || inOffset >= inSize ||
+        strnlen( &( inSection[ inOffset ] ), inSize - inOffset ) == 
+        inSize - inOffset ) {
+        return NULL;
+        }
+    return &( inSection[ inOffset ] );
+    }
+
+
+
+// reads one attribute of a DWARF 5 directory or file entry
+// string forms set *outString, everything else sets *outValue
+static char readLineHeaderForm( unsigned char **ioPos, unsigned char *inEnd,
+                                int inForm, int inOffsetSize,
+                                DwarfStrings *inStrings,
+                                const char **outString, 
+                                unsigned long *outValue ) {
+    unsigned long offset;
+    unsigned long length;
+    
+    *outString = NULL;
+    *outValue = 0;
+    
+    switch( inForm ) {
+        case DW_FORM_string:
+            *outString = (const char *)*ioPos;
+            while( *ioPos < inEnd && **ioPos != '\0' ) {
+                (*ioPos)++;
+                }
+            if( *ioPos >= inEnd ) {
+                return false;
+                }
+            (*ioPos)++;
+            return true;
+        case DW_FORM_strp:
+        case DW_FORM_line_strp:
+            if( ! readFixed( ioPos, inEnd, inOffsetSize, &offset ) ) {
+                return false;
+                }
+            if( inForm == DW_FORM_strp ) {
+                *outString = getDwarfString( inStrings->debugStr,
+                                             inStrings->debugStrSize,
+                                             offset );
+                }
+            else {
+                *outString = getDwarfString( inStrings->lineStr,
+                                             inStrings->lineStrSize,
+                                             offset );
+                }
+            return ( *outString != NULL );
+        case DW_FORM_data1:
+            return readFixed( ioPos, inEnd, 1, outValue );
+        case DW_FORM_data2:
+            return readFixed( ioPos, inEnd, 2, outValue );
+        case DW_FORM_data4:
+            return readFixed( ioPos, inEnd, 4, outValue );
+        case DW_FORM_data8:
+            return readFixed( ioPos, inEnd, 8, outValue );
+        case DW_FORM_data16:
+            *ioPos += 16;
+            return ( *ioPos <= inEnd );
+        case DW_FORM_udata:
+            *outValue = readULEB128( ioPos, inEnd );
+            return true;
+        case DW_FORM_sdata:
+            *outValue = readSLEB128( ioPos, inEnd );
+            return true;
+        case DW_FORM_block:
+        case DW_FORM_block1:
+        case DW_FORM_block2:
+        case DW_FORM_block4:
+            if( inForm == DW_FORM_block ) {
+                length = readULEB128( ioPos, inEnd );
+                }
+            else if( ! readFixed( ioPos, inEnd, 
+                                  inForm == DW_FORM_block1 ? 1 :
+                                  inForm == DW_FORM_block2 ? 2 : 4,
+                                  &length ) ) {
+                return false;
+                }
+            if( length > (unsigned long)( inEnd - *ioPos ) ) {
+                return false;
+                }
+            *ioPos += length;
+            return true;
+        default:
+            // strx forms need .debug_str_offsets from .debug_info
+            return false;
+        }
+    }
+
+
+
+// reads a DWARF 5 directory or file name table
+// outDirIndices can be NULL for the directory table
+static char readLineEntryTable( unsigned char **ioPos, unsigned char *inEnd,
+                                int inOffsetSize, DwarfStrings *inStrings,
+                                SimpleVector<const char *> *outNames,
+                                SimpleVector<unsigned long> *outDirIndices ) {
+    if( *ioPos >= inEnd ) {
+        return false;
+        }
+    int formatCount = **ioPos;
+    (*ioPos)++;
+    
+    unsigned long contentTypes[ 256 ];
+    unsigned long forms[ 256 ];
+    
+    for( int i=0; i<formatCount; i++ ) {
+        contentTypes[i] = readULEB128( ioPos, inEnd );
+        forms[i] = readULEB128( ioPos, inEnd );
+        }
+    
+    unsigned long count = readULEB128( ioPos, inEnd );
+    
+    for( unsigned long e=0; e<count; e++ ) {
+        const char *name = NULL;
+        unsigned long dirIndex = 0;
+        
+        for( int i=0; i<formatCount; i++ ) {
+            const char *string;
+            unsigned long value;
+            
+            if( ! readLineHeaderForm( ioPos, inEnd, forms[i], inOffsetSize,
+                                      inStrings, &string, &value ) ) {
+                return false;
+                }
+            if( contentTypes[i] == DW_LNCT_path ) {
+                name = string;
+                }
+            else if( contentTypes[i] == DW_LNCT_directory_index ) {
+                dirIndex = value;
+                }
+            }
+        if( name == NULL ) {
+            return false;
+            }
+        outNames->push_back( name );
+        
+        if( outDirIndices != NULL ) {
+            outDirIndices->push_back( dirIndex );
+            }
+        }
+    return true;
+    }
+
+
+
+// reads the zero-terminated string lists of a DWARF 2-4 header
+static char readLineStringList( unsigned char **ioPos, unsigned char *inEnd,
+                                SimpleVector<const char *> *outNames,
+                                SimpleVector<unsigned long> *outDirIndices ) {
+    while( *ioPos < inEnd && **ioPos != '\0' ) {
+        const char *name = (const char *)*ioPos;
+        
+        while( *ioPos < inEnd && **ioPos != '\0' ) {
+            (*ioPos)++;
+            }
+        if( *ioPos >= inEnd ) {
+            return false;
+            }
+        (*ioPos)++;
+        
+        outNames->push_back( name );
+        
+        if( outDirIndices != NULL ) {
+            outDirIndices->push_back( readULEB128( ioPos, inEnd ) );
+            // modification time and length
+            readULEB128( ioPos, inEnd );
+            readULEB128( ioPos, inEnd );
+            }
+        }
+    if( *ioPos >= inEnd ) {
+        return false;
+        }
+    // skip terminator
+    (*ioPos)++;
+    return true;
+    }
+
+
+
+// state for turning one unit's line program into LineEntry rows
+typedef struct LineUnit {
+        ElfFile *dest;
+        
+        int version;
+        SimpleVector<const char *> dirNames;
+        SimpleVector<const char *> fileNames;
+        SimpleVector<unsigned long> fileDirIndices;
+        
+        // index into dest->lineFiles for each file, -1 until a row uses it
+        SimpleVector<int> fileMap;
+        
+        // first row of the current sequence
+        int sequenceStart;
+        int lastFileIndex;
+        int lastLine;
+    } LineUnit;
+
+
+
+// returns -1 for a file number that isn't in the table
+static int getLineFileIndex( LineUnit *inUnit, unsigned long inFile ) {
+    // file numbers are 1-based before DWARF 5
+    if( inUnit->version < 5 ) {
+        if( inFile == 0 ) {
+            return -1;
+            }
+        inFile--;
+        }
+    if( inFile >= (unsigned long)inUnit->fileNames.size() ) {
+        return -1;
+        }
+    
+    int *mapped = inUnit->fileMap.getElementFast( inFile );
+    
+    if( *mapped == -1 ) {
+        LineFile f;
+        f.name = inUnit->fileNames.getElementDirect( inFile );
+        f.dir = NULL;
+        
+        unsigned long dirIndex = 
+            inUnit->fileDirIndices.getElementDirect( inFile );
+        
+        // before DWARF 5, directory 0 is the compilation directory,
+        // which only .debug_info knows
+        if( inUnit->version < 5 ) {
+            if( dirIndex > 0 && 
+                dirIndex <= (unsigned long)inUnit->dirNames.size() ) {
+                f.dir = inUnit->dirNames.getElementDirect( dirIndex - 1 );
+                }
+            }
+        else if( dirIndex < (unsigned long)inUnit->dirNames.size() ) {
+            f.dir = inUnit->dirNames.getElementDirect( dirIndex );
+            }
+        
+        *mapped = inUnit->dest->lineFiles.size();
+        inUnit->dest->lineFiles.push_back( f );
+        }
+    return *mapped;
+    }
+
+
+
+static void addLineRow( LineUnit *inUnit, unsigned long inAddress, 
+                        unsigned long inFile, long inLine,
+                        char inEndSequence ) {
+    SimpleVector<LineEntry> *table = &( inUnit->dest->lineTable );
+    
+    if( inEndSequence ) {
+        LineEntry *first = NULL;
+        if( inUnit->sequenceStart < table->size() ) {
+            first = table->getElementFast( inUnit->sequenceStart );
+            }
+        
+        if( first != NULL && first->address == 0 ) {
+            // code that the linker threw away, whose rows all
+            // got relocated to 0
+            table->shrink( inUnit->sequenceStart );
+            }
+        else if( first != NULL ) {
+            LineEntry end = { inAddress, -1, 0 };
+            table->push_back( end );
+            }
+        inUnit->sequenceStart = table->size();
+        inUnit->lastFileIndex = -1;
+        inUnit->lastLine = -1;
+        return;
+        }
+    
+    int fileIndex = getLineFileIndex( inUnit, inFile );
+    
+    if( fileIndex == -1 ) {
+        return;
+        }
+    
+    // only keep rows where the file or line actually changes
+    if( fileIndex == inUnit->lastFileIndex && inLine == inUnit->lastLine ) {
+        return;
+        }
+    LineEntry row = { inAddress, fileIndex, (int32_t)inLine };
+    table->push_back( row );
+    
+    inUnit->lastFileIndex = fileIndex;
+    inUnit->lastLine = inLine;
+    }
+
+
+
+// runs the line number program of the unit at inPos
+// returns the start of the next unit, or NULL if there's no more
+// we can read
+static unsigned char *readLineUnit( ElfFile *ioDest, unsigned char *inPos,
+                                    unsigned char *inSectionEnd,
+                                    DwarfStrings *inStrings ) {
+    unsigned char *pos = inPos;
+    unsigned long length;
+    int offsetSize = 4;
+    
+    if( ! readFixed( &pos, inSectionEnd, 4, &length ) ) {
+        return NULL;
+        }
+    if( length == 0xffffffff ) {
+        offsetSize = 8;
+        if( ! readFixed( &pos, inSectionEnd, 8, &length ) ) {
+            return NULL;
+            }
+        }
+    if( length > (unsigned long)( inSectionEnd - pos ) ) {
+        return NULL;
+        }
+    unsigned char *end = pos + length;
+    
+    LineUnit unit;
+    unit.dest = ioDest;
+    unit.sequenceStart = ioDest->lineTable.size();
+    unit.lastFileIndex = -1;
+    unit.lastLine = -1;
+    
+    unsigned long value;
+    
+    if( ! readFixed( &pos, end, 2, &value ) ) {
+        return NULL;
+        }
+    unit.version = value;
+    
+    if( unit.version < 2 || unit.version > 5 ) {
+        // skip units we don't understand
+        return end;
+        }
+    
+    int addressSize = sizeof( long );
+    
+    if( unit.version >= 5 ) {
+        if( ! readFixed( &pos, end, 1, &value ) ) {
+            return NULL;
+            }
+        addressSize = value;
+        // segment selector size
+        pos++;
+        }
+    
+    unsigned long headerLength;
+    if( ! readFixed( &pos, end, offsetSize, &headerLength ) ||
+        headerLength > (unsigned long)( end - pos ) ) {
+        return end;
+        }
+    unsigned char *program = pos + headerLength;
+    
+    if( pos + 4 > end ) {
+        return end;
+        }
+    int minInstructionLength = *pos;
+    pos++;
+    
+    if( unit.version >= 4 ) {
+        // max ops per instruction, only for VLIW
+        pos++;
+        }
+    int defaultIsStmt = *pos;
+    pos++;
+    int lineBase = (signed char)( *pos );
+    pos++;
+    int lineRange = *pos;
+    pos++;
+    
+    if( pos >= end ) {
+        return end;
+        }
+    int opcodeBase = *pos;
+    pos++;
+    
+    if( lineRange == 0 || opcodeBase == 0 ) {
+        return end;
+        }
+    
+    unsigned char *standardOpcodeLengths = pos;
+    pos += opcodeBase - 1;
+    
+    char headerOK;
+    
+    if( unit.version >= 5 ) {
+        headerOK = 
+            readLineEntryTable( &pos, program, offsetSize, inStrings,
+                                &( unit.dirNames ), NULL ) &&
+            readLineEntryTable( &pos, program, offsetSize, inStrings,
+                                &( unit.fileNames ), 
+                                &( unit.fileDirIndices ) );
+        }
+    else {
+        headerOK = 
+            readLineStringList( &pos, program, &( unit.dirNames ), NULL ) &&
+            readLineStringList( &pos, program, &( unit.fileNames ),
+                                &( unit.fileDirIndices ) );
+        }
+    if( ! headerOK ) {
+        return end;
+        }
+    
+    for( int i=0; i<unit.fileNames.size(); i++ ) {
+        unit.fileMap.push_back( -1 );
+        }
+    
+    
+    // the state machine registers
+    unsigned long address = 0;
+    unsigned long file = 1;
+    long line = 1;
+    (void)defaultIsStmt;
+    
+    pos = program;
+    
+    while( pos < end ) {
+        int op = *pos;
+        pos++;
+        
+        if( op >= opcodeBase ) {
+            // special opcode
+            int adjusted = op - opcodeBase;
+            address += ( adjusted / lineRange ) * minInstructionLength;
+            line += lineBase + adjusted % lineRange;
+            
+            addLineRow( &unit, address, file, line, false );
+            continue;
+            }
+        
+        switch( op ) {
+            case 0: {
+                // extended opcode
+                unsigned long opLength = readULEB128( &pos, end );
+                
+                if( opLength == 0 || 
+                    opLength > (unsigned long)( end - pos ) ) {
+                    return end;
+                    }
+                unsigned char *opEnd = pos + opLength;
+                int extendedOp = *pos;
+                pos++;
+                
+                if( extendedOp == 1 ) {
+                    // DW_LNE_end_sequence
+                    addLineRow( &unit, address, file, line, true );
+                    address = 0;
+                    file = 1;
+                    line = 1;
+                    }
+                else if( extendedOp == 2 ) {
+                    // DW_LNE_set_address
+                    if( ! readFixed( &pos, opEnd, addressSize, 
+                                     &address ) ) {
+                        return end;
+                        }
+                    }
+                else if( extendedOp == 3 && unit.version < 5 &&
+                         strnlen( (char *)pos, opEnd - pos ) < 
+                         (unsigned long)( opEnd - pos ) ) {
+                    // DW_LNE_define_file
+                    unit.fileNames.push_back( (const char *)pos );
+                    pos += strlen( (char *)pos ) + 1;
+                    
+                    unit.fileDirIndices.push_back( 
+                        readULEB128( &pos, opEnd ) );
+                    unit.fileMap.push_back( -1 );
+                    }
+                // anything else, like DW_LNE_set_discriminator, 
+                // doesn't matter to us
+                pos = opEnd;
+                break;
+                }
+            case 1:
+                // DW_LNS_copy
+                addLineRow( &unit, address, file, line, false );
+                break;
+            case 2:
+                // DW_LNS_advance_pc
+                address += readULEB128( &pos, end ) * minInstructionLength;
+                break;
+            case 3:
+                // DW_LNS_advance_line
+                line += readSLEB128( &pos, end );
+                break;
+            case 4:
+                // DW_LNS_set_file
+                file = readULEB128( &pos, end );
+                break;
+            case 8:
+                // DW_LNS_const_add_pc
+                address += 
+                    ( ( 255 - opcodeBase ) / lineRange ) * 
+                    minInstructionLength;
+                break;
+            case 9:
+                // DW_LNS_fixed_advance_pc
+                if( ! readFixed( &pos, end, 2, &value ) ) {
+                    return end;
+                    }
+                address += value;
+                break;
+            default:
+                // set_column, negate_stmt, etc., which we don't track,
+                // or opcodes from a later standard
+                for( int i=0; i<standardOpcodeLengths[ op - 1 ]; i++ ) {
+                    readULEB128( &pos, end );
+                    }
+                break;
+            }
+        }
+    
+    return end;
+    }
+
+
+
+static int compareLineEntries( const void *inA, const void *inB ) {
+    const LineEntry *a = (const LineEntry *)inA;
+    const LineEntry *b = (const LineEntry *)inB;
+    
+    if( a->address < b->address ) {
+        return -1;
+        }
+    if( a->address > b->address ) {
+        return 1;
+        }
+    // the end of one sequence can be the start of the next, and the
+    // lookup takes the last row at an address
+    return a->fileIndex - b->fileIndex;
+    }
+
+
+
+static void readLineTable( ElfFile *inSource, ElfFile *ioDest ) {
+    ElfW(Shdr) *section = findElfSection( inSource, ".debug_line" );
+    
+    if( section == NULL ) {
+        return;
+        }
+    
+    DwarfStrings strings = { NULL, 0, NULL, 0 };
+    
+    ElfW(Shdr) *debugStr = findElfSection( inSource, ".debug_str" );
+    ElfW(Shdr) *lineStr = findElfSection( inSource, ".debug_line_str" );
+    
+    if( debugStr != NULL ) {
+        strings.debugStr = 
+            (const char *)( inSource->image + debugStr->sh_offset );
+        strings.debugStrSize = debugStr->sh_size;
+        }
+    if( lineStr != NULL ) {
+        strings.lineStr = 
+            (const char *)( inSource->image + lineStr->sh_offset );
+        strings.lineStrSize = lineStr->sh_size;
+        }
+    
+    unsigned char *pos = inSource->image + section->sh_offset;
+    unsigned char *end = pos + section->sh_size;
+    
+    while( pos != NULL && pos < end ) {
+        pos = readLineUnit( ioDest, pos, end, &strings );
+        }
+    
+    if( ioDest->lineTable.size() > 0 ) {
+        qsort( ioDest->lineTable.getElementFast( 0 ), 
+               ioDest->lineTable.size(),
+               sizeof( LineEntry ), compareLineEntries );
+        
+        ioDest->lines = ioDest->lineTable.getElementFast( 0 );
+        ioDest->numLines = ioDest->lineTable.size();
+        }
+    }
+
+
+
+// the symbol cache file format, all native byte order, everything
+// 8-byte aligned:
+//    SymbolCacheHeader
+//    CachedSymbol[ numSymbols ]
+//    CachedLineFile[ numFiles ]
+//    LineEntry[ numLines ]
+//    strings, as offsets from the start of this block
+
+#define SYMBOL_CACHE_MAGIC "wcpSym1"
+
+// strings offset for a NULL string
+#define NO_CACHED_STRING 0xffffffff
+
+
+typedef struct SymbolCacheHeader {
+        char magic[8];
+        // sizeof( long ) of the writer
+        uint32_t pointerSize;
+        uint32_t numSymbols;
+        uint32_t numFiles;
+        uint32_t numLines;
+        uint64_t stringsSize;
+    } SymbolCacheHeader;
+
+
+typedef struct CachedSymbol {
+        uint64_t address;
+        uint64_t size;
+        uint64_t nameOffset;
+    } CachedSymbol;
+
+
+typedef struct CachedLineFile {
+        uint32_t dirOffset;
+        uint32_t nameOffset;
+    } CachedLineFile;
+
+
+
+// returns NULL if we have nowhere to put a cache
+static char *getSymbolCachePath( const char *inBuildID ) {
+    char *cacheDir;
+    
+    const char *xdgCache = getenv( "XDG_CACHE_HOME" );
+    const char *home = getenv( "HOME" );
+    
+    if( xdgCache != NULL && xdgCache[0] == '/' ) {
+        cacheDir = autoSprintf( "%s/wallClockProfiler", xdgCache );
+        }
+    else if( home != NULL && home[0] == '/' ) {
+        char *parent = autoSprintf( "%s/.cache", home );
+        mkdir( parent, 0755 );
+        delete [] parent;
+        
+        cacheDir = autoSprintf( "%s/.cache/wallClockProfiler", home );
+        }
+    else {
+        return NULL;
+        }
+    
+    mkdir( cacheDir, 0755 );
+    
+    char *path = autoSprintf( "%s/%s.sym", cacheDir, inBuildID );
+    delete [] cacheDir;
+    
+    return path;
+    }
+
+
+
+static const char *getCachedString( const char *inStrings, 
+                                    uint64_t inStringsSize,
+                                    uint64_t inOffset ) {
+    if( inOffset == NO_CACHED_STRING ) {
+        return NULL;
+        }
+    return getDwarfString( inStrings, inStringsSize, inOffset );
+    }
+
+
+
+static char loadSymbolCache( ElfFile *ioElf ) {
+    char *path = getSymbolCachePath( ioElf->buildID );
+    
+    if( path == NULL ) {
+        return false;
+        }
+    int fd = open( path, O_RDONLY );
+    delete [] path;
+    
+    if( fd == -1 ) {
+        return false;
+        }
+    
+    struct stat fileStat;
+    if( fstat( fd, &fileStat ) != 0 || 
+        fileStat.st_size < (long)sizeof( SymbolCacheHeader ) ) {
+        close( fd );
+        return false;
+        }
+    
+    void *image = mmap( NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE,
+                        fd, 0 );
+    close( fd );
+    
+    if( image == MAP_FAILED ) {
+        return false;
+        }
+    
+    unsigned char *data = (unsigned char *)image;
+    unsigned long size = fileStat.st_size;
+    
+    SymbolCacheHeader *header = (SymbolCacheHeader *)data;
+    
+    uint64_t symbolsOffset = sizeof( SymbolCacheHeader );
+    uint64_t filesOffset = 
+        symbolsOffset + header->numSymbols * sizeof( CachedSymbol );
+    uint64_t linesOffset = 
+        filesOffset + header->numFiles * sizeof( CachedLineFile );
+    uint64_t stringsOffset = 
+        linesOffset + header->numLines * sizeof( LineEntry );
+    
+    if( memcmp( header->magic, SYMBOL_CACHE_MAGIC, 8 ) != 0 ||
+        header->pointerSize != sizeof( long ) ||
+        stringsOffset + header->stringsSize != size ) {
+        munmap( image, size );
+        return false;
+        }
+    
+    ioElf->cacheImage = data;
+    ioElf->cacheImageSize = size;
+    
+    CachedSymbol *symbols = (CachedSymbol *)( data + symbolsOffset );
+    CachedLineFile *files = (CachedLineFile *)( data + filesOffset );
+    const char *strings = (const char *)( data + stringsOffset );
+    
+    for( unsigned int i=0; i<header->numSymbols; i++ ) {
+        ElfSymbol sym = { (unsigned long)symbols[i].address, 
+                          (unsigned long)symbols[i].size,
+                          getCachedString( strings, header->stringsSize,
+                                           symbols[i].nameOffset ),
+                          NULL };
+        if( sym.name == NULL ) {
+            sym.name = "??";
+            }
+        ioElf->symbols.push_back( sym );
+        }
+    
+    for( unsigned int i=0; i<header->numFiles; i++ ) {
+        LineFile f;
+        f.dir = getCachedString( strings, header->stringsSize,
+                                 files[i].dirOffset );
+        f.name = getCachedString( strings, header->stringsSize,
+                                  files[i].nameOffset );
+        if( f.name == NULL ) {
+            f.name = "??";
+            }
+        ioElf->lineFiles.push_back( f );
+        }
+    
+    // used in place
+    ioElf->lines = (LineEntry *)( data + linesOffset );
+    ioElf->numLines = header->numLines;
+    
+    for( int i=0; i<ioElf->numLines; i++ ) {
+        if( ioElf->lines[i].fileIndex >= (int)header->numFiles ) {
+            // corrupt, don't trust any of it
+            ioElf->lines = NULL;
+            ioElf->numLines = 0;
+            break;
+            }
+        }
+    
+    return true;
+    }
+
+
+
+// appends inString to ioStrings, returning its offset
+static uint64_t addCachedString( SimpleVector<char> *ioStrings, 
+                                 const char *inString ) {
+    if( inString == NULL ) {
+        return NO_CACHED_STRING;
+        }
+    uint64_t offset = ioStrings->size();
+    ioStrings->appendArray( (char *)inString, strlen( inString ) + 1 );
+    return offset;
+    }
+
+
+
+static void saveSymbolCache( ElfFile *inElf ) {
+    char *path = getSymbolCachePath( inElf->buildID );
+    
+    if( path == NULL ) {
+        return;
+        }
+    
+    // written to the side and renamed into place, so a concurrent
+    // session never maps half a file
+    char *tempPath = autoSprintf( "%s.%d.tmp", path, (int)getpid() );
+    
+    FILE *f = fopen( tempPath, "wb" );
+    
+    if( f == NULL ) {
+        delete [] tempPath;
+        delete [] path;
+        return;
+        }
+    
+    SimpleVector<char> strings;
+    
+    SymbolCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, SYMBOL_CACHE_MAGIC, 8 );
+    header.pointerSize = sizeof( long );
+    header.numSymbols = inElf->symbols.size();
+    header.numFiles = inElf->lineFiles.size();
+    header.numLines = inElf->numLines;
+    
+    SimpleVector<CachedSymbol> symbols;
+    
+    for( int i=0; i<inElf->symbols.size(); i++ ) {
+        ElfSymbol *sym = inElf->symbols.getElementFast( i );
+        
+        CachedSymbol c = { sym->address, sym->size,
+                           addCachedString( &strings, sym->name ) };
+        symbols.push_back( c );
+        }
+    
+    SimpleVector<CachedLineFile> files;
+    
+    for( int i=0; i<inElf->lineFiles.size(); i++ ) {
+        LineFile *lineFile = inElf->lineFiles.getElementFast( i );
+        
+        CachedLineFile c = { 
+            (uint32_t)addCachedString( &strings, lineFile->dir ),
+            (uint32_t)addCachedString( &strings, lineFile->name ) };
+        files.push_back( c );
+        }
+    
+    header.stringsSize = strings.size();
+    
+    char ok = ( fwrite( &header, sizeof( header ), 1, f ) == 1 );
+    
+    if( ok && symbols.size() > 0 ) {
+        ok = ( fwrite( symbols.getElementFast( 0 ), sizeof( CachedSymbol ),
+                       symbols.size(), f ) == (size_t)symbols.size() );
+        }
+    if( ok && files.size() > 0 ) {
+        ok = ( fwrite( files.getElementFast( 0 ), sizeof( CachedLineFile ),
+                       files.size(), f ) == (size_t)files.size() );
+        }
+    if( ok && inElf->numLines > 0 ) {
+        ok = ( fwrite( inElf->lines, sizeof( LineEntry ), 
+                       inElf->numLines, f ) == (size_t)inElf->numLines );
+        }
+    if( ok && strings.size() > 0 ) {
+        ok = ( fwrite( strings.getElementFast( 0 ), 1, strings.size(), 
+                       f ) == (size_t)strings.size() );
+        }
+    
+    if( fclose( f ) != 0 ) {
+        ok = false;
+        }
+    
+    if( ok ) {
+        rename( tempPath, path );
+        }
+    else {
+        unlink( tempPath );
+        }
+    
+    delete [] tempPath;
+    delete [] path;
+    }
+
+
+
+static void loadElfDebugInfo( ElfFile *ioElf ) {
+    ioElf->debugInfoLoaded = true;
+    
+    if( ioElf->image == NULL ) {
+        return;
+        }
+    
+    ioElf->buildID = readBuildID( ioElf );
+    
+    if( ioElf->buildID != NULL && loadSymbolCache( ioElf ) ) {
+        return;
+        }
+    
+    ioElf->debugFile = findDebugFile( ioElf );
+    
+    addElfSymbols( ioElf, ioElf );
+    
+    if( ioElf->debugFile != NULL ) {
+        addElfSymbols( ioElf->debugFile, ioElf );
+        }
+    sortElfSymbols( ioElf );
+    
+    readLineTable( ioElf, ioElf );
+    
+    if( ioElf->numLines == 0 && ioElf->debugFile != NULL ) {
+        readLineTable( ioElf->debugFile, ioElf );
+        }
+    
+    // the vDSO has a build ID too, but it's cheap to read and its image
+    // is our own copy
+    if( ioElf->buildID != NULL && ! ioElf->imageIsCopy ) {
+        saveSymbolCache( ioElf );
+        }
+    }
+
+
+
+// memoryRegionsReadCount the last time loadMappedDebugInfo looked
+static int debugInfoRegionsCount = -1;
+
+
+// for every ELF file mapped now, before sampling starts, and again on the
+// worker after the map has been re-read, for libraries loaded since
+// the files are picked out under symbolTablesLock, but loaded after 
+// letting it go
+static void loadMappedDebugInfo() {
+    symbolTablesLock.lock();
+    
+    if( memoryRegionsReadCount == debugInfoRegionsCount ) {
+        symbolTablesLock.unlock();
+        return;
+        }
+    debugInfoRegionsCount = memoryRegionsReadCount;
+    
+    SimpleVector<ElfFile *> toLoad;
+    
+    for( int i=0; i<memoryRegions.size(); i++ ) {
+        MemoryRegion *r = memoryRegions.getElementFast( i );
+        
+        if( r->executable && r->elf != NULL && 
+            ! r->elf->debugInfoLoaded ) {
+            toLoad.push_back( r->elf );
+            }
+        }
+    symbolTablesLock.unlock();
+    
+    for( int i=0; i<toLoad.size(); i++ ) {
+        ElfFile *e = toLoad.getElementDirect( i );
+        
+        // two regions can share a file
+        if( ! e->debugInfoLoaded ) {
+            loadElfDebugInfo( e );
+            }
+        }
+    }
+
+
+
+// returns NULL if there's no line information for inAddress
+static LineEntry *lookupLine( ElfFile *inElf, unsigned long inAddress ) {
+    int low = 0;
+    int high = inElf->numLines - 1;
+    int found = -1;
+    
+    while( low <= high ) {
+        int mid = ( low + high ) / 2;
+        
+        if( inElf->lines[ mid ].address <= inAddress ) {
+            found = mid;
+            low = mid + 1;
+            }
+        else {
+            high = mid - 1;
+            }
+        }
+    
+    if( found == -1 || inElf->lines[ found ].fileIndex < 0 ||
+        inElf->lines[ found ].line <= 0 ) {
+        return NULL;
+        }
+    return &( inElf->lines[ found ] );
+    }
+
+
+
+
+// **************************************
+// deferred symbolization
+
+// with deferSymbols, samples carry nothing but frame addresses
+// once sampling is over, each unique address is named exactly once
+// from the ELF files in our memory map snapshot, and every frame is
+// pointed at the shared result
+
+
+// one entry per unique (address, isCaller), sorted
+SimpleVector<StackFrame> resolvedFrames;
+
+
+
+static int compareFrameAddresses( const void *inA, const void *inB ) {
+    const StackFrame *a = (const StackFrame *)inA;
+    const StackFrame *b = (const StackFrame *)inB;
+    
+    if( a->address < b->address ) {
+        return -1;
+        }
+    if( a->address > b->address ) {
+        return 1;
+        }
+    return a->isCaller - b->isCaller;
+    }
+
+
+
+static void symbolizeFrame( StackFrame *ioFrame ) {
+    unsigned long pc = (unsigned long)ioFrame->address;
+    
+    if( pc == 0 ) {
+        // a [truncated] frame, already named
+        return;
+        }
+    
+    ioFrame->lineNum = -1;
+    ioFrame->fileNameID = 0;
+    
+    // a return address can be just past the end of a noreturn call's
+    // function, so look up the call instruction instead
+    unsigned long lookupAddress = ioFrame->isCaller ? pc - 1 : pc;
+    
+    // the native sampling thread may be reading the memory map again, 
+    // but the ELF file a region points to is kept until we're done, and
+    // its debug info is only touched here
+    symbolTablesLock.lock();
+    
+    MemoryRegion *r = findMemoryRegion( lookupAddress );
+    
+    ElfFile *e = NULL;
+    unsigned long loadBias = 0;
+    
+    if( r != NULL ) {
+        e = r->elf;
+        loadBias = r->loadBias;
+        }
+    
+    symbolTablesLock.unlock();
+    
+    const char *name = NULL;
+    
+    if( e != NULL ) {
+        if( ! e->debugInfoLoaded ) {
+            loadElfDebugInfo( e );
+            }
+        
+        unsigned long elfAddress = lookupAddress - loadBias;
+        
+        name = lookupElfSymbol( e, elfAddress );
+        
+        LineEntry *line = lookupLine( e, elfAddress );
+        
+        if( line != NULL ) {
+            LineFile *file = e->lineFiles.getElementFast( line->fileIndex );
+            
+            // just the name as compiled, like GDB's file field
+            ioFrame->fileNameID = internString( file->name );
+            ioFrame->lineNum = line->line;
+            
+            if( ! hasSourcePath( ioFrame->fileNameID ) &&
+                file->dir != NULL && file->name[0] != '/' ) {
+                char *path = autoSprintf( "%s/%s", file->dir, file->name );
+                setSourcePath( ioFrame->fileNameID, path );
+                delete [] path;
+                }
+            }
+        }
+    
+    if( name != NULL ) {
+        ioFrame->funcNameID = internString( name );
+        }
+    else {
+        ioFrame->funcNameID = internString( "??" );
+        }
+    }
+
+
+
+static void fillResolvedFrame( StackFrame *ioFrame ) {
+    StackFrame *resolved = (StackFrame *)bsearch( 
+        ioFrame, resolvedFrames.getElementFast( 0 ), 
+        resolvedFrames.size(), sizeof( StackFrame ), 
+        compareFrameAddresses );
+    
+    ioFrame->funcNameID = resolved->funcNameID;
+    ioFrame->fileNameID = resolved->fileNameID;
+    ioFrame->lineNum = resolved->lineNum;
+    }
+
+
+
+static void fillResolvedFrames( SimpleVector<Stack> *inStacks ) {
+    for( int i=0; i<inStacks->size(); i++ ) {
+        Stack *s = inStacks->getElementFast( i );
+        
+        for( int f=0; f<s->numFrames; f++ ) {
+            fillResolvedFrame( &( s->frames[f] ) );
+            }
+        }
+    }
+
+
+
+// names every frame in stackLog, callTree and threadLog
+// run again for each snapshot, as more stacks come in, so it only looks 
+// up addresses it hasn't named before
+static void resolveDeferredSymbols() {
+    SimpleVector<StackFrame> allFrames;
+    
+    for( int i=0; i<stackLog.size(); i++ ) {
+        Stack *s = stackLog.getElementFast( i );
+        
+        allFrames.push_back( s->frames, s->numFrames );
+        }
+    
+    if( allFrames.size() > 0 ) {
+        qsort( allFrames.getElementFast( 0 ), allFrames.size(), 
+               sizeof( StackFrame ), compareFrameAddresses );
+        }
+    
+    int numAlreadyResolved = resolvedFrames.size();
+    
+    for( int i=0; i<allFrames.size(); i++ ) {
+        StackFrame *f = allFrames.getElementFast( i );
+        
+        if( i > 0 && 
+            compareFrameAddresses( f, allFrames.getElementFast( i - 1 ) ) 
+            == 0 ) {
+            continue;
+            }
+        if( numAlreadyResolved > 0 &&
+            bsearch( f, resolvedFrames.getElementFast( 0 ), 
+                     numAlreadyResolved, sizeof( StackFrame ), 
+                     compareFrameAddresses ) != NULL ) {
+            continue;
+            }
+        StackFrame resolved = *f;
+        symbolizeFrame( &resolved );
+        
+        resolvedFrames.push_back( resolved );
+        }
+    
+    if( resolvedFrames.size() > numAlreadyResolved ) {
+        qsort( resolvedFrames.getElementFast( 0 ), resolvedFrames.size(), 
+               sizeof( StackFrame ), compareFrameAddresses );
+        }
+    
+    fprintf( reportFile, "%d unique addresses resolved\n", 
+             resolvedFrames.size() );
+    
+    fillResolvedFrames( &stackLog );
+    
+    // every node's frame came from a stack in stackLog
+    for( int i=0; i<callTree.size(); i++ ) {
+        fillResolvedFrame( &( callTree.getElementFast( i )->frame ) );
+        }
+    
+    for( int t=0; t<threadLog.size(); t++ ) {
+        fillResolvedFrames( &( threadLog.getElementFast( t )->stacks ) );
+        }
+    }
+
+
+
+static void freeResolvedFrames() {
+    resolvedFrames.deleteAll();
+    }
+
+
+
+
+// **************************************
+// source lines for the report
+
+// each source file that a printed stack points into is mapped once, with
+// an index of where its lines start, so the report doesn't take a GDB 
+// round trip per stack
+// GDB's list is only asked about files we can't find, since it knows 
+// its own source search paths
+
+
+typedef struct SourceFile {
+        // NULL if the file couldn't be found
+        char *data;
+        long size;
+        // offset of the start of each line, line 1 first
+        SimpleVector<long> lineStarts;
+    } SourceFile;
+
+
+SimpleVector<SourceFile *> sourceFiles;
+
+// index into sourceFiles by the file name's string ID, -1 if we haven't
+// looked for it yet
+SimpleVector<int> sourceFileIndex;
+
+
+
+static SourceFile *loadSourceFile( const char *inPath ) {
+    SourceFile *file = new SourceFile;
+    file->data = NULL;
+    file->size = 0;
+    
+    int fd = open( inPath, O_RDONLY );
+    
+    if( fd == -1 ) {
+        return file;
+        }
+    
+    struct stat fileStat;
+    
+    if( fstat( fd, &fileStat ) != 0 || ! S_ISREG( fileStat.st_mode ) ) {
+        close( fd );
+        return file;
+        }
+    
+    if( fileStat.st_size == 0 ) {
+        // found, but has no lines
+        file->data = (char *)"";
+        close( fd );
+        return file;
+        }
+    
+    void *image = mmap( NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE,
+                        fd, 0 );
+    close( fd );
+    
+    if( image == MAP_FAILED ) {
+        return file;
+        }
+    
+    file->data = (char *)image;
+    file->size = fileStat.st_size;
+    
+    long pos = 0;
+    
+    while( pos < file->size ) {
+        file->lineStarts.push_back( pos );
+        
+        char *newline = (char *)memchr( &( file->data[ pos ] ), '\n', 
+                                        file->size - pos );
+        if( newline == NULL ) {
+            break;
+            }
+        pos = newline + 1 - file->data;
+        }
+    
+    return file;
+    }
+
+
+
+// returns NULL if the file named by inFileNameID can't be found, at the
+// path we were given for it or relative to where we're running
+static SourceFile *getSourceFile( unsigned int inFileNameID ) {
+    while( sourceFileIndex.size() <= (int)inFileNameID ) {
+        sourceFileIndex.push_back( -1 );
+        }
+    
+    int index = sourceFileIndex.getElementDirect( inFileNameID );
+    
+    if( index == -1 ) {
+        SourceFile *file = NULL;
+        
+        if( hasSourcePath( inFileNameID ) ) {
+            file = loadSourceFile( 
+                getString( sourcePathIDs.getElementDirect( inFileNameID ) ) );
+            }
+        
+        if( file == NULL || file->data == NULL ) {
+            delete file;
+            file = loadSourceFile( getString( inFileNameID ) );
+            }
+        
+        index = sourceFiles.size();
+        sourceFiles.push_back( file );
+        *( sourceFileIndex.getElementFast( inFileNameID ) ) = index;
+        }
+    
+    SourceFile *file = sourceFiles.getElementDirect( index );
+    
+    if( file->data == NULL ) {
+        return NULL;
+        }
+    return file;
+    }
+
+
+
+// prints line inLineNum of inFile, if it has one
+static void printSourceLine( SourceFile *inFile, int inLineNum ) {
+    if( inLineNum < 1 || inLineNum > inFile->lineStarts.size() ) {
+        return;
+        }
+    
+    long start = inFile->lineStarts.getElementDirect( inLineNum - 1 );
+    long end = inFile->size;
+    
+    if( inLineNum < inFile->lineStarts.size() ) {
+        end = inFile->lineStarts.getElementDirect( inLineNum );
+        }
+    
+    // trim spaces from start, and the newline from the end
+    while( start < end && 
+           ( inFile->data[ start ] == ' ' || 
+             inFile->data[ start ] == '\t' ) ) {
+        start++;
+        }
+    while( end > start && 
+           ( inFile->data[ end - 1 ] == '\n' || 
+             inFile->data[ end - 1 ] == '\r' ) ) {
+        end--;
+        }
+    
+    fprintf( reportFile, "            %d:|   %.*s\n", 
+             inLineNum, (int)( end - start ), &( inFile->data[ start ] ) );
+    }
+
+
+
+static void freeSourceFiles() {
+    for( int i=0; i<sourceFiles.size(); i++ ) {
+        SourceFile *file = sourceFiles.getElementDirect( i );
+        
+        if( file->size > 0 ) {
+            munmap( file->data, file->size );
+            }
+        delete file;
+        }
+    sourceFiles.deleteAll();
+    sourceFileIndex.deleteAll();
+    sourcePathIDs.deleteAll();
+    }
+
+
+
+void printStack( Stack *inStack, int inNumTotalSamples ) {
+    Stack *s = inStack;
+    
+    fprintf( reportFile, 
+             "%7.3f%% ===================================== (%d samples)\n"
+             "       %3d: %s   (at %s:%d)\n", 
+             100 * s->sampleCount / (float )inNumTotalSamples,
+             s->sampleCount,
+             1,
+             getString( s->frames[0].funcNameID ), 
+             getString( s->frames[0].fileNameID ), 
+             s->frames[0].lineNum );
+
+    StackFrame *sf = &( inStack->frames[0] );
+    const char *sfFileName = getString( sf->fileNameID );
+    
+    SourceFile *sourceFile = NULL;
+    
+    if( sf->lineNum > 0 ) {
+        sourceFile = getSourceFile( sf->fileNameID );
+        }
+    
+    if( sourceFile != NULL ) {
+        printSourceLine( sourceFile, sf->lineNum );
+        }
+    // no GDB to list source lines for us with the native backend, or
+    // when reporting from a recording or a snapshot
+    else if( sf->lineNum > 0 && 
+             ! useNativeBackend && ! reportWithoutGDB ) {
+        
+        char *listCommand = autoSprintf( "list %s:%d,%d",
+                                         sfFileName,
+                                         sf->lineNum,
+                                         sf->lineNum );
+        sendCommand( listCommand );
+        
+        delete [] listCommand;
+        
+        char *response = getGDBResponse();
+        
+        char *marker = autoSprintf( "~\"%d\\t", sf->lineNum );
+        
+        char *markerSpot = strstr( response, marker );
+        
+        // if name present in line, it's a not-found error
+        if( markerSpot != NULL &&
+            strstr( markerSpot, sfFileName ) == NULL ) {
+            char *lineStart = &( markerSpot[ strlen( marker ) ] );
+            
+            // trim spaces from start
+            while( lineStart[0] == ' ' ) {
+                lineStart = &( lineStart[1] );
+                }
+            
+            char *lineEnd = strstr( lineStart, "\\n" );
+            if( lineEnd != NULL ) {
+                lineEnd[0] ='\0';
+                }
+            fprintf( reportFile, "            %d:|   %s\n", 
+                     sf->lineNum, lineStart );
+            }
+        
+        delete [] marker;
+        delete [] response;
+        }
+    
+
+    // print stack for context below
+    for( int j=1; j<s->numFrames; j++ ) {
+        StackFrame *f = &( s->frames[j] );
+        fprintf( reportFile, "       %3d: %s   (at %s:%d)\n", 
+                 j + 1,
+                 getString( f->funcNameID ), 
+                 getString( f->fileNameID ), 
+                 f->lineNum );
+        }
+    fprintf( reportFile, "\n\n" );
+    }
+
+
+
+
+
+// the per-thread breakdown, thread names by share of all samples, 
+// then each one's stacks
+// most samples first, ties in the order they were first seen
+static int compareStacksBySamples( const void *inA, const void *inB ) {
+    Stack *a = *(Stack **)inA;
+    Stack *b = *(Stack **)inB;
+    
+    if( a->sampleCount != b->sampleCount ) {
+        return b->sampleCount - a->sampleCount;
+        }
+    // all from the same vector, so address order is insertion order
+    if( a < b ) {
+        return -1;
+        }
+    if( a > b ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+// fills outSorted with pointers into inStacks, most samples first
+// the stacks themselves aren't copied or moved
+static void sortStacksBySamples( SimpleVector<Stack> *inStacks,
+                                 SimpleVector<Stack *> *outSorted ) {
+    for( int i=0; i<inStacks->size(); i++ ) {
+        outSorted->push_back( inStacks->getElementFast( i ) );
+        }
+    if( outSorted->size() > 0 ) {
+        qsort( outSorted->getElementFast( 0 ), outSorted->size(), 
+               sizeof( Stack * ), compareStacksBySamples );
+        }
+    }
+
+
+
+// adds up, for each function name, the samples of every stack that it
+// appears in, and of every stack that it's at the top of
+// names are interned, so their IDs index the records directly, and 
+// this is one pass over all frames in stackLog
+static void countFunctions( SimpleVector<FunctionRecord> *outFunctions ) {
+    int numStrings = stringOffsets.size();
+    
+    // -1 for names that aren't functions we've seen
+    int *recordIndices = new int[ numStrings ];
+    memset( recordIndices, -1, numStrings * sizeof( int ) );
+    
+    for( int i=0; i<stackLog.size(); i++ ) {
+        Stack *s = stackLog.getElementFast( i );
+        
+        for( int f=0; f<s->numFrames; f++ ) {
+            unsigned int funcNameID = s->frames[f].funcNameID;
+            
+            if( recordIndices[ funcNameID ] == -1 ) {
+                FunctionRecord newFunc = 
+                    { funcNameID, 0, 0, -1, outFunctions->size() };
+                outFunctions->push_back( newFunc );
+                
+                recordIndices[ funcNameID ] = outFunctions->size() - 1;
+                }
+            
+            FunctionRecord *record = 
+                outFunctions->getElementFast( recordIndices[ funcNameID ] );
+            
+            if( f == 0 ) {
+                record->selfCount += s->sampleCount;
+                }
+            
+            if( record->lastStack != i ) {
+                // this function was already reported by this stack
+                // otherwise
+                record->lastStack = i;
+                record->sampleCount += s->sampleCount;
+                }
+            }
+        }
+    
+    delete [] recordIndices;
+    }
+
+
+
+static int compareFunctionsBySelf( const void *inA, const void *inB ) {
+    FunctionRecord *a = *(FunctionRecord **)inA;
+    FunctionRecord *b = *(FunctionRecord **)inB;
+    
+    if( a->selfCount != b->selfCount ) {
+        return b->selfCount - a->selfCount;
+        }
+    // in the order they were first seen
+    return a->firstSeen - b->firstSeen;
+    }
+
+
+
+static int compareFunctionsBySamples( const void *inA, const void *inB ) {
+    FunctionRecord *a = (FunctionRecord *)inA;
+    FunctionRecord *b = (FunctionRecord *)inB;
+    
+    if( a->sampleCount != b->sampleCount ) {
+        return b->sampleCount - a->sampleCount;
+        }
+    // in the order they were first seen
+    return a->firstSeen - b->firstSeen;
+    }
+
+
+
+static int compareCallNodes( const void *inA, const void *inB ) {
+    CallNode *a = callTree.getElementFast( *(int *)inA );
+    CallNode *b = callTree.getElementFast( *(int *)inB );
+    
+    if( a->depth != b->depth ) {
+        return a->depth - b->depth;
+        }
+    if( a->sampleCount != b->sampleCount ) {
+        return b->sampleCount - a->sampleCount;
+        }
+    // otherwise in the order we first saw them
+    return *(int *)inA - *(int *)inB;
+    }
+
+
+
+// prints the callTree nodes down to partialStackDepth that have at 
+// least partialStackThreshold samples, grouped by depth
+static void printPartialStacks( int inNumTotalSamples ) {
+    SimpleVector<int> nodes;
+    
+    for( int i=0; i<callTree.size(); i++ ) {
+        CallNode *n = callTree.getElementFast( i );
+        
+        if( n->depth <= partialStackDepth &&
+            n->sampleCount >= partialStackThreshold ) {
+            nodes.push_back( i );
+            }
+        }
+    
+    if( nodes.size() == 0 ) {
+        return;
+        }
+    
+    qsort( nodes.getElementFast( 0 ), nodes.size(), sizeof( int ), 
+           compareCallNodes );
+    
+    int lastDepth = 0;
+    
+    for( int i=0; i<nodes.size(); i++ ) {
+        CallNode *n = callTree.getElementFast( nodes.getElementDirect( i ) );
+        
+        if( n->depth != lastDepth ) {
+            lastDepth = n->depth;
+            
+            if( partialStackThreshold == 2 ) {
+                fprintf( reportFile, "\n\n\nPartial stacks of depth [%d] "
+                         "with more than one sample:\n\n", lastDepth );
+                }
+            else {
+                fprintf( reportFile, "\n\n\nPartial stacks of depth [%d] "
+                         "with at least %d samples:\n\n", 
+                         lastDepth, partialStackThreshold );
+                }
+            }
+        
+        // innermost frame first, like a full stack
+        Stack partial;
+        partial.frames = new StackFrame[ n->depth ];
+        partial.numFrames = 0;
+        partial.sampleCount = n->sampleCount;
+        partial.hash = 0;
+        partial.callNode = nodes.getElementDirect( i );
+        
+        for( CallNode *p = n; p != NULL; ) {
+            partial.frames[ partial.numFrames ] = p->frame;
+            partial.numFrames++;
+            
+            p = ( p->parent == -1 ) 
+                ? NULL : callTree.getElementFast( p->parent );
+            }
+        
+        printStack( &partial, inNumTotalSamples );
+        
+        delete [] partial.frames;
+        }
+    }
+
+
+
+static int compareThreadsBySamples( const void *inA, const void *inB ) {
+    ThreadRecord *a = *(ThreadRecord **)inA;
+    ThreadRecord *b = *(ThreadRecord **)inB;
+    
+    if( a->sampleCount != b->sampleCount ) {
+        return b->sampleCount - a->sampleCount;
+        }
+    // in the order they were first seen
+    if( a < b ) {
+        return -1;
+        }
+    if( a > b ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+// only called with at least two thread names
+static void printThreadReport( int inNumTotalSamples ) {
+    SimpleVector<ThreadRecord *> sortedThreads;
+    
+    for( int i=0; i<threadLog.size(); i++ ) {
+        sortedThreads.push_back( threadLog.getElementFast( i ) );
+        }
+    
+    qsort( sortedThreads.getElementFast( 0 ), sortedThreads.size(),
+           sizeof( ThreadRecord * ), compareThreadsBySamples );
+    
+    
+    fprintf( reportFile, "\n\n\nThreads:\n\n" );
+    
+    for( int i=0; i<sortedThreads.size(); i++ ) {
+        ThreadRecord *t = sortedThreads.getElementDirect( i );
+        
+        fprintf( reportFile, 
+                 "%7.3f%% ===================================== (%d samples)\n"
+                 "         %s   (%d thread%s)\n\n\n",
+                 100 * t->sampleCount / (float )inNumTotalSamples,
+                 t->sampleCount,
+                 t->name,
+                 t->threadIDs.size(),
+                 t->threadIDs.size() == 1 ? "" : "s" );
+        }
+    
+    
+    for( int i=0; i<sortedThreads.size(); i++ ) {
+        ThreadRecord *t = sortedThreads.getElementDirect( i );
+        
+        fprintf( reportFile, "\n\n\nStacks of thread '%s' "
+                 "with at least one sample:\n\n", t->name );
+        
+        SimpleVector<Stack *> stacks;
+        sortStacksBySamples( &( t->stacks ), &stacks );
+        
+        for( int s=0; s<stacks.size(); s++ ) {
+            printStack( stacks.getElementDirect( s ), t->sampleCount );
+            }
+        }
+    }
+
+
+
+static void freeThreadLog() {
+    for( int i=0; i<threadLog.size(); i++ ) {
+        delete [] threadLog.getElementFast( i )->name;
+        freeStackIndex( &( threadLog.getElementFast( i )->stackIndex ) );
+        }
+    threadLog.deleteAll();
+    
+    threadRecordIndices.deleteAll();
+    threadEntries.deleteAll();
+    
+    if( threadEntrySlots != NULL ) {
+        delete [] threadEntrySlots;
+        threadEntrySlots = NULL;
+        }
+    numThreadEntrySlots = 0;
+    }
+
+
+
+
+// starts GDB on inProgName and runs or attaches to the target
+// takes ownership of inProgName and inProgArgs
+// returns the PID of the target, or -1 on failure
+static int startGDBTarget( int inNumArgs, char **inArgs,
+                           char *progName, char *progArgs ) {
+
+    int readPipe[2];
+    int writePipe[2];
+    
+    pipe( readPipe );
+    pipe( writePipe );
+
+
+
+    int childPID = fork();
+    
+    if( childPID == -1 ) {
+        printf( "Failed to fork\n" );
+        
+        delete [] progName;
+        delete [] progArgs;
+        
+        return -1;
+        }
+    else if( childPID == 0 ) {
+        // child
+        dup2( writePipe[0], STDIN_FILENO );
+        dup2( readPipe[1], STDOUT_FILENO );
+        dup2( readPipe[1], STDERR_FILENO );
+
+        while( false && true ) {
+            printf( "test\n" );
+            }
+        
+        //ask kernel to deliver SIGTERM in case the parent dies
+        prctl( PR_SET_PDEATHSIG, SIGTERM );
+
+        execlp( "gdb", "gdb", "-nx", "--interpreter=mi", progName, NULL );
+        
+        delete [] progName;
+        delete [] progArgs;
+        
+        exit( 0 );
+        }
+    
+    // else parent
+    printf( "Forked GDB child on PID=%d\n", childPID );
+	
+	
+    char debugFileName[256];
+    
+    if( inNumArgs == 3 ) {
+        sprintf( debugFileName, "wcGDB.log" );
+        }
+    else {
+        snprintf( debugFileName, sizeof( debugFileName ), 
+                  "wcGDB.%s.log", inArgs[3] );
+        }
+    
+    logFile = fopen( debugFileName, "w" );
+
+    printf( "Logging GDB commands and responses to %s\n", debugFileName );
+    
+    
+    //close unused pipe ends
+    close( writePipe[0] );
+    close( readPipe[1] );
+    
+    inPipe = readPipe[0];
+    outPipe = writePipe[1];
+
+    fcntl( inPipe, F_SETFL, O_NONBLOCK );
+
+    char *gdbInitResponse = getGDBResponse();
+    
+    if( strstr( gdbInitResponse, "No such file or directory." ) != NULL ) {
+        delete [] gdbInitResponse;
+        printf( "GDB failed to start program '%s'\n", progName );
+        closeLogFile();
+        delete [] progName;
+        delete [] progArgs;
+        exit( 0 );
+        }
+    delete [] gdbInitResponse;
+    
+
+    
+    sendCommand( "handle SIGPIPE nostop noprint pass" );
+    
+    skipGDBResponse();
+    
+
+
+    if( nonStopMode ) {
+        // both have to be set before the target is started
+        sendCommand( "-gdb-set target-async 1" );
+        skipGDBResponse();
+        gdbIsAsync = true;
+        
+        sendCommand( "-gdb-set non-stop on" );
+        skipGDBResponse();
+        }
+
+
+    if( inNumArgs == 3 && nonStopMode ) {
+        // a plain run would keep GDB busy until the target stopped,
+        // and we need to be able to interrupt single threads
+        char *argsCommand = 
+            autoSprintf( "-exec-arguments %s > wcOut.txt", progArgs );
+        
+        sendCommand( argsCommand );
+        delete [] argsCommand;
+        
+        skipGDBResponse();
+        
+        printf( "\n\nStarting gdb program with '-exec-run', "
+                "redirecting program output to wcOut.txt\n" );
+        
+        sendCommand( "-exec-run" );
+        }
+    else if( inNumArgs == 3 ) {
+        char *runCommand = autoSprintf( "run %s > wcOut.txt", progArgs );
+
+        printf( "\n\nStarting gdb program with '%s', "
+                "redirecting program output to wcOut.txt\n",
+                runCommand );
+        
+        sendCommand( runCommand );
+        delete [] runCommand;
+        }
+    else {
+        if( ! nonStopMode ) {
+            sendCommand( "-gdb-set target-async 1" );
+            skipGDBResponse();
+            gdbIsAsync = true;
+            }
+
+        printf( "\n\nAttaching to PID %s\n", inArgs[3] );
+
+        char *command = autoSprintf( "-target-attach %s\n", inArgs[3] );
+
+        sendCommand( command ); 
+
+        delete [] command;
+        
+        
+        char *gdbAttachResponse = getGDBResponse();
+        
+        if( strstr( gdbAttachResponse, "ptrace: No such process." ) != NULL ) {
+            delete [] gdbAttachResponse;
+            printf( "GDB could not find process:  %s\n", inArgs[3] );
+            closeLogFile();
+            delete [] progName;
+            delete [] progArgs;
+            exit( 0 );
+            }
+        else if( strstr( gdbAttachResponse, 
+                         "ptrace: Operation not permitted." ) != NULL ) {
+            delete [] gdbAttachResponse;
+            printf( "GDB could not attach to process %s "
+                    "(maybe you need to be root?)\n", inArgs[3] );
+            closeLogFile();
+            delete [] progName;
+            delete [] progArgs;
+            exit( 0 );
+            }
+        
+        delete [] gdbAttachResponse;
+
+        printf( "\n\nResuming attached gdb program with '-exec-continue'\n" );
+        
+        if( nonStopMode ) {
+            // otherwise only the current thread would be resumed
+            sendCommand( "-exec-continue --all" );
+            }
+        else {
+            sendCommand( "-exec-continue" );
+            }
+        }
+
+    delete [] progArgs;
+    
+    usleep( 100000 );
+
+    skipGDBResponse();
+    
+    printf( "Debugging program '%s'\n", inArgs[2] );
+
+    char *endOfPath = strrchr( inArgs[2], '/' );
+
+    char *fullProgName = progName;
+    
+    if( endOfPath != NULL ) {
+        progName = &( endOfPath[1] );
+        }
+    
+    char *pidCall = autoSprintf( "pidof %s", progName );
+
+    delete [] fullProgName;
+
+    FILE *pidPipe = popen( pidCall, "r" );
+    
+    delete [] pidCall;
+    
+    if( pidPipe == NULL ) {
+        printf( "Failed to open pipe to pidof to get debugged app pid\n" );
+        closeLogFile();
+        return -1;
+        }
+
+    int pid = -1;
+    
+    // if there are multiple GDP procs, they are printed in newest-first order
+    // this will get the pid of the latest one (our GDB child)
+    int numRead = fscanf( pidPipe, "%d", &pid );
+    
+    pclose( pidPipe );
+
+    if( numRead != 1 ) {
+        printf( "Failed to read PID of debugged app\n" );
+        closeLogFile();
+        return -1;
+        }
+    
+    printf( "PID of debugged process = %d\n", pid );
+    
+    return pid;
+    }
+
+
+
+// runs or attaches to the target with our own ptrace backend
+// returns the PID of the target, or -1 on failure
+static int startNativeTarget( int inNumArgs, char **inArgs,
+                              char *inProgName, char *inProgArgs ) {
+    int pid;
+    
+    if( inNumArgs == 3 ) {
+        pid = launchNativeTarget( inProgName, inProgArgs );
+        }
+    else {
+        printf( "\n\nAttaching to PID %s\n", inArgs[3] );
+        
+        pid = -1;
+        sscanf( inArgs[3], "%d", &pid );
+        
+        if( pid <= 0 || ! startNativeTrace( pid, false ) ) {
+            return -1;
+            }
+        }
+    
+    if( pid == -1 ) {
+        printf( "Failed to start program '%s'\n", inProgName );
+        return -1;
+        }
+    
+    readMemoryRegions( pid );
+    
+    printf( "Debugging program '%s'\n", inArgs[2] );
+    printf( "PID of debugged process = %d\n", pid );
+    
+    return pid;
+    }
+
+
+
+
+// the report proper, from stackLog, callTree and threadLog
+static void printReport( int inNumTotalSamples ) {
+    SimpleVector<FunctionRecord> functions;
+    
+    countFunctions( &functions );
+    
+    if( functions.size() > 0 ) {
+        qsort( functions.getElementFast( 0 ), functions.size(),
+               sizeof( FunctionRecord ), compareFunctionsBySamples );
+        }
+    
+    SimpleVector<Stack *> sortedStacks;
+    
+    sortStacksBySamples( &stackLog, &sortedStacks );
+
+
+    fprintf( reportFile, "\n\n\nReport:\n\n" );
+
+    fprintf( reportFile, "\n\n\nFunctions "
+             "with more than one sample:\n\n" );
+
+    for( int i=0; i<functions.size(); i++ ) {
+        FunctionRecord *f = functions.getElementFast( i );
+        
+        if( f->sampleCount <= 1 ) {
+            // sorted, so the rest have one sample too
+            break;
+            }
+        
+        fprintf( reportFile, "%7.3f%% ===================================== "
+                 "(%d samples, %d self)\n"
+                 "         %s\n\n\n",
+                 100 * f->sampleCount / (float )inNumTotalSamples,
+                 f->sampleCount,
+                 f->selfCount,
+                 getString( f->funcNameID ) );
+        }
+    
+    
+    // where the time is actually spent, rather than what it's spent
+    // under
+    SimpleVector<FunctionRecord *> bySelf;
+    
+    for( int i=0; i<functions.size(); i++ ) {
+        if( functions.getElementFast( i )->selfCount > 1 ) {
+            bySelf.push_back( functions.getElementFast( i ) );
+            }
+        }
+    
+    if( bySelf.size() > 0 ) {
+        qsort( bySelf.getElementFast( 0 ), bySelf.size(),
+               sizeof( FunctionRecord * ), compareFunctionsBySelf );
+        
+        fprintf( reportFile, "\n\n\nFunctions at the top of the stack "
+                 "with more than one sample:\n\n" );
+        
+        for( int i=0; i<bySelf.size(); i++ ) {
+            FunctionRecord *f = bySelf.getElementDirect( i );
+            
+            fprintf( reportFile, 
+                     "%7.3f%% ===================================== "
+                     "(%d self samples)\n"
+                     "         %s\n\n\n",
+                     100 * f->selfCount / (float )inNumTotalSamples,
+                     f->selfCount,
+                     getString( f->funcNameID ) );
+            }
+        }
+                
+
+
+    printPartialStacks( inNumTotalSamples );
+    
+    
+    fprintf( reportFile, "\n\n\nFull stacks "
+             "with at least one sample:\n\n" );
+    
+    for( int i=0; i<sortedStacks.size(); i++ ) {
+        printStack( sortedStacks.getElementDirect( i ), inNumTotalSamples );
+        }
+    
+    // only interesting when there's more than one kind of thread
+    if( threadLog.size() > 1 ) {
+        printThreadReport( inNumTotalSamples );
+        }
+    }
+
+
+
+// **************************************
+// finishing a recording, and reporting from one
+
+
+// the counts behind the summary, which a recording ends with
+typedef struct SamplingSummary {
+        int numSamples;
+        int numStackSamples;
+        double samplingSeconds;
+        double samplesPerSecond;
+        // how long the target was paused in that time, in microseconds
+        double pauseTime;
+        // stacks cut off at maxStackDepth, and results that held no 
+        // stack, in that time
+        int numTruncatedStacks;
+        int numDroppedStacks;
+    } SamplingSummary;
+
+
+
+// numSamples is -1 if it isn't known
+static void printSamplingSummary( SamplingSummary *inSummary ) {
+    if( inSummary->numSamples >= 0 ) {
+        fprintf( reportFile, "%d stack samples taken\n", 
+                 inSummary->numSamples );
+        }
+    
+    if( inSummary->samplingSeconds > 0 ) {
+        fprintf( reportFile, "%.2f samples per second requested, %.2f achieved "
+                 "over %.3f seconds\n", 
+                 inSummary->samplesPerSecond, 
+                 inSummary->numSamples / inSummary->samplingSeconds, 
+                 inSummary->samplingSeconds );
+        
+        // in non-stop mode, this adds up the pauses of single threads
+        double overheadPercent = 
+            100 * inSummary->pauseTime / 
+            ( inSummary->samplingSeconds * 1000000 );
+        
+        if( maxOverheadPercent > 0 ) {
+            fprintf( reportFile, "Target paused for %.2f%% of that time "
+                     "(limit %g%%)\n", 
+                     overheadPercent, maxOverheadPercent );
+            }
+        else {
+            fprintf( reportFile, "Target paused for %.2f%% of that time\n", 
+                     overheadPercent );
+            }
+        }
+    
+    fprintf( reportFile, "%d thread stacks sampled across %d thread names\n", 
+             inSummary->numStackSamples, threadLog.size() );
+
+    fprintf( reportFile, "%d unique stacks sampled\n", stackLog.size() );
+    
+    fprintf( reportFile, "%d stacks cut off at %d frames, %d dropped\n", 
+             inSummary->numTruncatedStacks, maxStackDepth, 
+             inSummary->numDroppedStacks + numRingDroppedStacks );
+    
+    printPauseReport();
+    }
+
+
+
+// names for frames written before deferred symbols were looked up, the 
+// paths of source files, and the summary
+static void finishRecording( SamplingSummary *inSummary ) {
+    if( deferSymbols ) {
+        for( int i=0; i<recordedFrames.size(); i++ ) {
+            StackFrame f = recordedFrames.getElementDirect( i );
+            fillResolvedFrame( &f );
+            
+            writeNewRecordingStrings();
+            
+            putc( FRAME_NAMES_RECORDING, recordingFile );
+            writeRecordingVarint( i );
+            writeRecordingVarint( f.funcNameID );
+            writeRecordingVarint( f.fileNameID );
+            writeRecordingSigned( f.lineNum );
+            }
+        }
+    
+    writeNewRecordingStrings();
+    
+    for( int i=0; i<sourcePathIDs.size(); i++ ) {
+        if( sourcePathIDs.getElementDirect( i ) != 0 ) {
+            putc( SOURCE_PATH_RECORDING, recordingFile );
+            writeRecordingVarint( i );
+            writeRecordingVarint( sourcePathIDs.getElementDirect( i ) );
+            }
+        }
+    
+    putc( SUMMARY_RECORDING, recordingFile );
+    writeRecordingVarint( inSummary->numSamples );
+    writeRecordingVarint( inSummary->numStackSamples );
+    writeRecordingVarint( lrint( inSummary->samplingSeconds * 1000000 ) );
+    writeRecordingVarint( lrint( inSummary->samplesPerSecond * 1000 ) );
+    writeRecordingSigned( lrint( maxOverheadPercent * 1000 ) );
+    writeRecordingVarint( nonStopMode );
+    writeRecordingVarint( maxStackDepth );
+    writeRecordingVarint( numTruncatedStacks );
+    writeRecordingVarint( numDroppedStacks + numRingDroppedStacks );
+    writeRecordingVarint( numPauses );
+    writeRecordingVarint( lrint( totalPauseTime ) );
+    writeRecordingVarint( longestPause );
+    
+    // just the buckets that were used, by distance from the last one
+    int lastBucket = 0;
+    int numUsed = 0;
+    for( int i=0; i<NUM_PAUSE_BUCKETS; i++ ) {
+        if( pauseBuckets[i] > 0 ) {
+            numUsed++;
+            }
+        }
+    writeRecordingVarint( numUsed );
+    
+    for( int i=0; i<NUM_PAUSE_BUCKETS; i++ ) {
+        if( pauseBuckets[i] > 0 ) {
+            writeRecordingVarint( i - lastBucket );
+            writeRecordingVarint( pauseBuckets[i] );
+            lastBucket = i;
+            }
+        }
+    
+    if( ferror( recordingFile ) ) {
+        printf( "Error writing the recording\n" );
+        }
+    fclose( recordingFile );
+    recordingFile = NULL;
+    
+    delete [] recordedFrameSlots;
+    recordedFrameSlots = NULL;
+    recordedFrames.deleteAll();
+    lastRecordedStack.deleteAll();
+    }
+
+
+
+typedef struct RecordingReader {
+        unsigned char *pos;
+        unsigned char *end;
+        // set by any read past the end, or a value out of range
+        char failed;
+    } RecordingReader;
+
+
+
+static unsigned long readRecordingVarint( RecordingReader *inReader ) {
+    unsigned long value = 0;
+    int shift = 0;
     
+    while( inReader->pos < inReader->end && shift < 64 ) {
+        unsigned char byte = *( inReader->pos++ );
+        
+        value |= (unsigned long)( byte & 0x7F ) << shift;
+        
+        if( ! ( byte & 0x80 ) ) {
+            return value;
+            }
+        shift += 7;
+        }
+    
+    inReader->failed = true;
+    return 0;
+    }
+
 
-static StackFrame parseFrame( char *inFrameString ) {
-    StackFrame newF;
+
+static long readRecordingSigned( RecordingReader *inReader ) {
+    unsigned long value = readRecordingVarint( inReader );
     
-    char *openPos = strstr( inFrameString, "{" );
+    return (long)( value >> 1 ) ^ -(long)( value & 1 );
+    }
+
+
+
+// reads an ID that must be below inLimit
+static int readRecordingID( RecordingReader *inReader, int inLimit ) {
+    unsigned long value = readRecordingVarint( inReader );
     
-    if( openPos == NULL ) {
-        printf( "Error parsing stack frame:  %s\n", inFrameString );
-        exit( 1 );
+    if( value >= (unsigned long)inLimit ) {
+        inReader->failed = true;
+        return 0;
+        }
+    return (int)value;
+    }
+
+
+
+// reads a string ID from the file, and returns ours for it
+static unsigned int readRecordingString( RecordingReader *inReader,
+                                         SimpleVector<unsigned int> *inIDs ) {
+    int id = readRecordingID( inReader, inIDs->size() );
+    
+    if( inReader->failed ) {
+        return 0;
+        }
+    return inIDs->getElementDirect( id );
+    }
+
+
+
+// returns a new, \0-terminated copy
+static char *readRecordingBytes( RecordingReader *inReader ) {
+    unsigned long length = readRecordingVarint( inReader );
+    
+    if( length > (unsigned long)( inReader->end - inReader->pos ) ) {
+        inReader->failed = true;
+        return stringDuplicate( "" );
+        }
+    
+    char *bytes = new char[ length + 1 ];
+    memcpy( bytes, inReader->pos, length );
+    bytes[ length ] = '\0';
+    
+    inReader->pos += length;
+    
+    return bytes;
+    }
+
+
+
+// a thread written to a recording
+typedef struct RecordedThread {
+        int threadID;
+        unsigned int nameID;
+    } RecordedThread;
+
+
+// a sample read from a recording
+typedef struct RecordedSample {
+        int thread;
+        int stack;
+    } RecordedSample;
+
+
+
+// the report subcommand:  prints the report for a --record file
+// returns the exit code
+static int reportRecording( const char *inPath ) {
+    int fd = open( inPath, O_RDONLY );
+    
+    if( fd == -1 ) {
+        printf( "Could not open recording %s\n", inPath );
+        return 1;
+        }
+    
+    struct stat fileStat;
+    
+    if( fstat( fd, &fileStat ) != 0 || 
+        fileStat.st_size < RECORDING_MAGIC_LENGTH ) {
+        printf( "%s is not a wallClockProfiler recording\n", inPath );
+        close( fd );
+        return 1;
+        }
+    
+    void *image = mmap( NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE,
+                        fd, 0 );
+    close( fd );
+    
+    if( image == MAP_FAILED || 
+        memcmp( image, RECORDING_MAGIC, RECORDING_MAGIC_LENGTH ) != 0 ) {
+        printf( "%s is not a wallClockProfiler recording\n", inPath );
+        
+        if( image != MAP_FAILED ) {
+            munmap( image, fileStat.st_size );
+            }
+        return 1;
+        }
+    
+    RecordingReader reader;
+    reader.pos = (unsigned char *)image + RECORDING_MAGIC_LENGTH;
+    reader.end = (unsigned char *)image + fileStat.st_size;
+    reader.failed = false;
+    
+    // string IDs in the file, mapped to ours
+    SimpleVector<unsigned int> stringIDs;
+    
+    SimpleVector<StackFrame> frames;
+    
+    // the frame IDs of every stack, outermost first, one after another
+    SimpleVector<int> stackFrameIDs;
+    SimpleVector<int> stackStarts;
+    
+    SimpleVector<RecordedThread> threads;
+    SimpleVector<RecordedSample> samples;
+    
+    SamplingSummary summary;
+    char gotSummary = false;
+    
+    void *lastAddress = NULL;
+    
+    // a record cut off at the end means the profiler didn't finish, and
+    // everything before it is still good
+    while( reader.pos < reader.end && ! reader.failed ) {
+        int type = *( reader.pos++ );
+        
+        switch( type ) {
+            case START_RECORDING: {
+                time_t startTime = (time_t)readRecordingVarint( &reader );
+                char *progName = readRecordingBytes( &reader );
+                
+                printf( "Recording of '%s' started %s", progName, 
+                        ctime( &startTime ) );
+                delete [] progName;
+                break;
+                }
+            case STRING_RECORDING: {
+                char *s = readRecordingBytes( &reader );
+                stringIDs.push_back( internString( s ) );
+                delete [] s;
+                break;
+                }
+            case FRAME_RECORDING: {
+                StackFrame f;
+                f.address = (char *)lastAddress + 
+                    readRecordingSigned( &reader );
+                f.isCaller = ( readRecordingVarint( &reader ) != 0 );
+                f.funcNameID = readRecordingString( &reader, &stringIDs );
+                f.fileNameID = readRecordingString( &reader, &stringIDs );
+                f.lineNum = readRecordingSigned( &reader );
+                
+                lastAddress = f.address;
+                frames.push_back( f );
+                break;
+                }
+            case STACK_RECORDING: {
+                int numFrames = readRecordingID( &reader, 1 << 24 );
+                int shared = readRecordingID( &reader, numFrames + 1 );
+                
+                int lastStart = 0;
+                if( stackStarts.size() > 0 ) {
+                    lastStart = stackStarts.getLastElementDirect();
+                    }
+                
+                if( shared > stackFrameIDs.size() - lastStart ) {
+                    reader.failed = true;
+                    break;
+                    }
+                
+                stackStarts.push_back( stackFrameIDs.size() );
+                
+                for( int i=0; i<shared; i++ ) {
+                    stackFrameIDs.push_back( 
+                        stackFrameIDs.getElementDirect( lastStart + i ) );
+                    }
+                for( int i=shared; i<numFrames; i++ ) {
+                    stackFrameIDs.push_back( 
+                        readRecordingID( &reader, frames.size() ) );
+                    }
+                break;
+                }
+            case THREAD_RECORDING: {
+                RecordedThread t;
+                t.threadID = readRecordingVarint( &reader );
+                t.nameID = readRecordingString( &reader, &stringIDs );
+                threads.push_back( t );
+                break;
+                }
+            case SAMPLE_RECORDING: {
+                // times aren't part of the text report
+                readRecordingVarint( &reader );
+                
+                RecordedSample s;
+                s.thread = readRecordingID( &reader, threads.size() );
+                s.stack = readRecordingID( &reader, stackStarts.size() );
+                
+                if( ! reader.failed ) {
+                    samples.push_back( s );
+                    }
+                break;
+                }
+            case FRAME_NAMES_RECORDING: {
+                int id = readRecordingID( &reader, frames.size() );
+                
+                if( reader.failed ) {
+                    break;
+                    }
+                StackFrame *f = frames.getElementFast( id );
+                f->funcNameID = readRecordingString( &reader, &stringIDs );
+                f->fileNameID = readRecordingString( &reader, &stringIDs );
+                f->lineNum = readRecordingSigned( &reader );
+                break;
+                }
+            case SOURCE_PATH_RECORDING: {
+                unsigned int nameID = 
+                    readRecordingString( &reader, &stringIDs );
+                unsigned int pathID = 
+                    readRecordingString( &reader, &stringIDs );
+                
+                setSourcePath( nameID, getString( pathID ) );
+                break;
+                }
+            case SUMMARY_RECORDING: {
+                summary.numSamples = readRecordingVarint( &reader );
+                summary.numStackSamples = readRecordingVarint( &reader );
+                summary.samplingSeconds = 
+                    readRecordingVarint( &reader ) / 1000000.0;
+                summary.samplesPerSecond = 
+                    readRecordingVarint( &reader ) / 1000.0;
+                maxOverheadPercent = readRecordingSigned( &reader ) / 1000.0;
+                nonStopMode = readRecordingVarint( &reader );
+                maxStackDepth = readRecordingVarint( &reader );
+                numTruncatedStacks = readRecordingVarint( &reader );
+                numDroppedStacks = readRecordingVarint( &reader );
+                numPauses = readRecordingVarint( &reader );
+                totalPauseTime = readRecordingVarint( &reader );
+                longestPause = readRecordingVarint( &reader );
+                
+                int numUsed = readRecordingID( &reader, NUM_PAUSE_BUCKETS + 1 );
+                int bucket = 0;
+                
+                for( int i=0; i<numUsed; i++ ) {
+                    bucket += readRecordingVarint( &reader );
+                    
+                    if( bucket >= NUM_PAUSE_BUCKETS ) {
+                        reader.failed = true;
+                        break;
+                        }
+                    pauseBuckets[ bucket ] = readRecordingVarint( &reader );
+                    }
+                gotSummary = ! reader.failed;
+                break;
+                }
+            default:
+                reader.failed = true;
+                break;
+            }
+        }
+    
+    if( reader.failed ) {
+        printf( "Recording ends early or is damaged, reporting on what "
+                "came before that\n" );
+        }
+    
+    stackStarts.push_back( stackFrameIDs.size() );
+    
+    // the samples in the order they were taken, which is how logStack 
+    // numbers the stacks too
+    for( int i=0; i<samples.size(); i++ ) {
+        RecordedSample *s = samples.getElementFast( i );
+        RecordedThread *t = threads.getElementFast( s->thread );
+        
+        int start = stackStarts.getElementDirect( s->stack );
+        int numFrames = stackStarts.getElementDirect( s->stack + 1 ) - start;
+        
+        Stack thisStack;
+        thisStack.frames = (StackFrame *)arenaAlloc( 
+            &workerArena, numFrames * sizeof( StackFrame ) );
+        thisStack.numFrames = numFrames;
+        thisStack.sampleCount = 1;
+        thisStack.hash = 0;
+        thisStack.callNode = -1;
+        
+        // innermost first
+        for( int f=0; f<numFrames; f++ ) {
+            thisStack.frames[f] = *( frames.getElementFast( 
+                stackFrameIDs.getElementDirect( 
+                    start + numFrames - 1 - f ) ) );
+            }
+        
+        logThreadStack( t->threadID, getString( t->nameID ), thisStack );
+        
+        resetArena( &workerArena );
+        }
+    
+    munmap( image, fileStat.st_size );
+    
+    if( ! gotSummary ) {
+        printf( "Recording has no summary, since the profiler didn't "
+                "finish\n" );
+        summary.numSamples = -1;
+        summary.samplingSeconds = 0;
+        summary.samplesPerSecond = 0;
+        }
+    summary.numStackSamples = samples.size();
+    summary.pauseTime = totalPauseTime;
+    summary.numTruncatedStacks = numTruncatedStacks;
+    summary.numDroppedStacks = numDroppedStacks;
+    
+    printSamplingSummary( &summary );
+    
+    // no more samples to match
+    freeStackIndex( &stackLogIndex );
+    
+    printReport( samples.size() );
+    
+    freeThreadLog();
+    freeCallTree();
+    stackLog.deleteAll();
+    freeArena( &stackArena );
+    freeArena( &workerArena );
+    
+    return 0;
+    }
+
+
+
+// **************************************
+// snapshots of the report while sampling
+
+
+// where the current window's counts start, since the worker's own 
+// counts go on across windows
+// without --window, there's just one, from the start of sampling
+typedef struct WindowStart {
+        double time;
+        int numSamples;
+        double pauseTime;
+        int numTruncatedStacks;
+        int numDroppedStacks;
+    } WindowStart;
+
+WindowStart windowStart = { 0, 0, 0, 0, 0 };
+
+
+
+// called by the worker between samples, when everything it owns is 
+// consistent
+// the report of the current window goes to a temporary file that's 
+// renamed to inPath, so whatever is at inPath is always a whole report
+// deferred symbols are filled into the frames we're still logging into,
+// which doesn't matter to matching, since that goes by address
+static void writeReportFile( const char *inPath, const char *inHeader, 
+                             double inSampleTime ) {
+    char *tempPath = autoSprintf( "%s.tmp", inPath );
+    
+    FILE *file = fopen( tempPath, "w" );
+    
+    if( file == NULL ) {
+        delete [] tempPath;
+        return;
+        }
+    
+    reportFile = file;
+    
+    // GDB is busy with the samples
+    char oldReportWithoutGDB = reportWithoutGDB;
+    reportWithoutGDB = true;
+    
+    SamplingSummary summary;
+    summary.numSamples = numWorkerSamples - windowStart.numSamples;
+    summary.numStackSamples = 0;
+    summary.samplingSeconds = 
+        ( inSampleTime - windowStart.time ) / 1000000;
+    summary.samplesPerSecond = 1000000 / minSampleInterval;
+    summary.pauseTime = workerPauseTime - windowStart.pauseTime;
+    summary.numTruncatedStacks = 
+        numTruncatedStacks - windowStart.numTruncatedStacks;
+    summary.numDroppedStacks = 
+        numDroppedStacks - windowStart.numDroppedStacks;
+    
+    for( int i=0; i<threadLog.size(); i++ ) {
+        summary.numStackSamples += threadLog.getElementFast( i )->sampleCount;
+        }
+    
+    fprintf( reportFile, "%s\n", inHeader );
+    
+    printSamplingSummary( &summary );
+    
+    if( deferSymbols ) {
+        resolveDeferredSymbols();
+        }
+    
+    printReport( summary.numStackSamples );
+    
+    reportFile = stdout;
+    reportWithoutGDB = oldReportWithoutGDB;
+    
+    if( fclose( file ) == 0 ) {
+        rename( tempPath, inPath );
+        }
+    else {
+        unlink( tempPath );
+        }
+    
+    delete [] tempPath;
+    }
+
+
+
+static void writeSnapshot( double inSampleTime ) {
+    if( recordingFile != NULL ) {
+        // so the report subcommand can read everything up to here
+        fflush( recordingFile );
+        }
+    
+    if( snapshotPath == NULL ) {
+        return;
+        }
+    
+    char *header = autoSprintf( "Snapshot after %.3f seconds of sampling",
+                                ( inSampleTime - windowStart.time ) / 
+                                1000000 );
+    
+    writeReportFile( snapshotPath, header, inSampleTime );
+    
+    delete [] header;
+    }
+
+
+
+// **************************************
+// the live view
+
+// with --live, the worker redraws a top-style view of what's been 
+// sampled so far in the terminal's alternate screen, a few times a 
+// second, between two samples
+// it's drawn from stackLog, like the report, so the sampling thread 
+// doesn't do anything more for it
+// the stdin thread reads keys and leaves requests for the worker
+
+
+typedef enum LiveViewMode {
+    LIVE_FUNCTIONS,
+    LIVE_SELF,
+    LIVE_STACKS
+    } LiveViewMode;
+
+
+// set by the stdin thread
+std::atomic<int> liveViewMode( LIVE_FUNCTIONS );
+std::atomic<bool> liveResetRequested( false );
+
+
+// each stack's count, and the worker's totals, at the last reset
+// the view shows what's been sampled since
+// stacks past the end of liveBaseCounts are newer than the reset
+SimpleVector<int> liveBaseCounts;
+int liveBaseSamples = 0;
+double liveBasePauseTime = 0;
+double liveBaseTime = 0;
+
+
+// frames whose names were deferred, named for the view as they first 
+// show up in it, found by address like recordedFrames
+SimpleVector<StackFrame> liveFrames;
+int *liveFrameSlots = NULL;
+int numLiveFrameSlots = 0;
+
+
+// the terminal as it was before we took over its keys
+struct termios liveSavedTerminal;
+
+
+
+static void insertLiveFrameSlot( int inIndex ) {
+    int mask = numLiveFrameSlots - 1;
+    int slot = hashRecordedFrame( liveFrames.getElementFast( inIndex ) ) 
+        & mask;
+    
+    while( liveFrameSlots[ slot ] != -1 ) {
+        slot = ( slot + 1 ) & mask;
+        }
+    liveFrameSlots[ slot ] = inIndex;
+    }
+
+
+
+static unsigned int getLiveFuncName( StackFrame *inFrame ) {
+    if( ! deferSymbols || inFrame->address == NULL ) {
+        return inFrame->funcNameID;
+        }
+    
+    unsigned int hash = hashRecordedFrame( inFrame );
+    
+    if( numLiveFrameSlots > 0 ) {
+        int mask = numLiveFrameSlots - 1;
+        
+        for( int slot = hash & mask;
+             liveFrameSlots[ slot ] != -1;
+             slot = ( slot + 1 ) & mask ) {
+            
+            StackFrame *f = liveFrames.getElementFast( liveFrameSlots[ slot ] );
+            
+            if( f->address == inFrame->address &&
+                f->isCaller == inFrame->isCaller ) {
+                return f->funcNameID;
+                }
+            }
+        }
+    
+    StackFrame named = *inFrame;
+    
+    symbolizeFrame( &named );
+    
+    liveFrames.push_back( named );
+    
+    if( liveFrames.size() * 2 > numLiveFrameSlots ) {
+        // keep it at most half full
+        if( liveFrameSlots != NULL ) {
+            delete [] liveFrameSlots;
+            }
+        numLiveFrameSlots = 
+            numLiveFrameSlots == 0 ? 1024 : numLiveFrameSlots * 2;
+        
+        liveFrameSlots = new int[ numLiveFrameSlots ];
+        memset( liveFrameSlots, -1, numLiveFrameSlots * sizeof( int ) );
+        
+        for( int i=0; i<liveFrames.size(); i++ ) {
+            insertLiveFrameSlot( i );
+            }
+        }
+    else {
+        insertLiveFrameSlot( liveFrames.size() - 1 );
+        }
+    
+    return named.funcNameID;
+    }
+
+
+
+// the view is built up here, then written all at once
+SimpleVector<char> liveText;
+
+int liveColumns = 80;
+int liveRowsLeft = 0;
+
+
+
+static void addLiveText( const char *inText ) {
+    liveText.push_back( (char *)inText, strlen( inText ) );
+    }
+
+
+
+// adds a line, cut off at the terminal's width, unless the screen is
+// already full
+static void addLiveLine( const char *inFormat, ... ) {
+    if( liveRowsLeft <= 0 ) {
+        return;
+        }
+    liveRowsLeft--;
+    
+    char line[ 1024 ];
+    
+    va_list args;
+    va_start( args, inFormat );
+    vsnprintf( line, sizeof( line ), inFormat, args );
+    va_end( args );
+    
+    int length = strlen( line );
+    
+    if( length > liveColumns ) {
+        length = liveColumns;
+        }
+    liveText.push_back( line, length );
+    
+    // clear whatever the last view left on the rest of the line
+    addLiveText( "\033[K\n" );
+    }
+
+
+
+static void resetLiveView( double inSampleTime ) {
+    liveBaseCounts.deleteAll();
+    
+    for( int i=0; i<stackLog.size(); i++ ) {
+        liveBaseCounts.push_back( stackLog.getElementFast( i )->sampleCount );
+        }
+    
+    liveBaseSamples = numWorkerSamples;
+    liveBasePauseTime = workerPauseTime;
+    liveBaseTime = inSampleTime;
+    }
+
+
+
+// like countFunctions, with the view's names and counts
+static void drawLiveFunctions( int *inCounts, int inNumTotalSamples,
+                               char inBySelf ) {
+    SimpleVector<FunctionRecord> functions;
+    
+    // by name ID, -1 for names that aren't functions we've seen
+    SimpleVector<int> recordIndices;
+    
+    for( int i=0; i<stackLog.size(); i++ ) {
+        if( inCounts[i] == 0 ) {
+            continue;
+            }
+        Stack *s = stackLog.getElementFast( i );
+        
+        for( int f=0; f<s->numFrames; f++ ) {
+            unsigned int funcNameID = getLiveFuncName( &( s->frames[f] ) );
+            
+            while( recordIndices.size() <= (int)funcNameID ) {
+                recordIndices.push_back( -1 );
+                }
+            
+            if( recordIndices.getElementDirect( funcNameID ) == -1 ) {
+                FunctionRecord newFunc = 
+                    { funcNameID, 0, 0, -1, functions.size() };
+                functions.push_back( newFunc );
+                
+                *( recordIndices.getElementFast( funcNameID ) ) = 
+                    functions.size() - 1;
+                }
+            
+            FunctionRecord *record = functions.getElementFast( 
+                recordIndices.getElementDirect( funcNameID ) );
+            
+            if( f == 0 ) {
+                record->selfCount += inCounts[i];
+                }
+            
+            if( record->lastStack != i ) {
+                record->lastStack = i;
+                record->sampleCount += inCounts[i];
+                }
+            }
         }
-    openPos = &( openPos[1] );
     
-    char *closePos = strstr( openPos, "}" );
+    SimpleVector<FunctionRecord *> sorted;
     
-    if( closePos == NULL ) {
-        printf( "Error parsing stack frame:  %s\n", inFrameString );
-        exit( 1 );
+    if( functions.size() > 0 && ! inBySelf ) {
+        qsort( functions.getElementFast( 0 ), functions.size(),
+               sizeof( FunctionRecord ), compareFunctionsBySamples );
         }
-    closePos[0] ='\0';
-    
-    int numVals;
-    char **vals = split( openPos, "\",", &numVals );
-    
-    void *address = NULL;
     
-    for( int i=0; i<numVals; i++ ) {
-        if( strstr( vals[i], "addr=" ) == vals[i] ) {
-            sscanf( vals[i], "addr=\"%p\"", &address );
-            break;
-            }
+    for( int i=0; i<functions.size(); i++ ) {
+        sorted.push_back( functions.getElementFast( i ) );
         }
-
-    newF.address = address;
-    newF.lineNum = -1;
-    newF.funcName = NULL;
-    newF.fileName = NULL;
     
-    for( int i=0; i<numVals; i++ ) {
-	if( strstr( vals[i], "func=\"" ) == vals[i] ) {
-            char *start = vals[i] + strlen("func=\"");
-            unsigned int len = strcspn(start, "\"") + 1;
-            newF.funcName = new char[ len ];
-            strncpy(newF.funcName, start, len);
-    } else if( strstr( vals[i], "file=\"" ) == vals[i] ) {
-            char *start = vals[i] + strlen("file=\"");
-            unsigned int len = strcspn(start, "\"") + 1;
-            newF.fileName = new char[ len ];
-            strncpy(newF.fileName, start, len);
-    } else if( strstr( vals[i], "line=" ) == vals[i] ) {
-            sscanf( vals[i], "line=\"%d\"", &newF.lineNum );
-            }
+    if( sorted.size() > 0 && inBySelf ) {
+        qsort( sorted.getElementFast( 0 ), sorted.size(),
+               sizeof( FunctionRecord * ), compareFunctionsBySelf );
         }
     
-    if( newF.fileName == NULL ) {
-        newF.fileName = stringDuplicate( "" );
-        }
-    if( newF.funcName == NULL ) {
-        newF.funcName = stringDuplicate( "" );
-        }
+    addLiveLine( "  total     self  function" );
     
-    char *quotePos = strstr( newF.fileName, "\"" );
-    if( quotePos != NULL ) {
-        quotePos[0] ='\0';
-        }
-    quotePos = strstr( newF.funcName, "\"" );
-    if( quotePos != NULL ) {
-        quotePos[0] ='\0';
+    for( int i=0; i<sorted.size() && liveRowsLeft > 0; i++ ) {
+        FunctionRecord *f = sorted.getElementDirect( i );
+        
+        addLiveLine( "%6.2f%%  %6.2f%%  %s", 
+                     100 * f->sampleCount / (float)inNumTotalSamples,
+                     100 * f->selfCount / (float)inNumTotalSamples,
+                     getString( f->funcNameID ) );
         }
+    }
 
 
-    for( int i=0; i<numVals; i++ ) {
-        delete [] vals[i];
-        }
-    delete [] vals;
 
-    return newF;
+// for sorting stackLog indices by the view's counts
+int *liveSortCounts = NULL;
+
+
+static int compareLiveStacks( const void *inA, const void *inB ) {
+    int a = *(int *)inA;
+    int b = *(int *)inB;
+    
+    if( liveSortCounts[a] != liveSortCounts[b] ) {
+        return liveSortCounts[b] - liveSortCounts[a];
+        }
+    // otherwise in the order we first saw them
+    return a - b;
     }
 
 
 
-static void logGDBStackResponse() {
-    int numRead = fillBufferWithResponse();
+// each stack on one line, innermost frame first
+static void drawLiveStacks( int *inCounts, int inNumTotalSamples ) {
+    SimpleVector<int> sorted;
     
-    if( numRead == 0 ) {
-        return;
+    for( int i=0; i<stackLog.size(); i++ ) {
+        if( inCounts[i] > 0 ) {
+            sorted.push_back( i );
+            }
         }
     
-    log( "logGDBStackResponse sees", readBuff );
-
-    checkProgramExited();
-        
-    if( programExited ) {
-        return;
+    if( sorted.size() > 0 ) {
+        liveSortCounts = inCounts;
+        qsort( sorted.getElementFast( 0 ), sorted.size(), sizeof( int ),
+               compareLiveStacks );
         }
     
-    const char *stackStartMarker = ",stack=[";
+    addLiveLine( "  total  stack, innermost first" );
     
-    char *stackStartPos = strstr( readBuff, ",stack=[" );
+    char line[ 1024 ];
+    
+    for( int i=0; i<sorted.size() && liveRowsLeft > 0; i++ ) {
+        int index = sorted.getElementDirect( i );
+        Stack *s = stackLog.getElementFast( index );
         
-    if( stackStartPos == NULL ) {
-        return;
+        int length = snprintf( line, sizeof( line ), "%6.2f%%  ", 
+                               100 * inCounts[ index ] / 
+                               (float)inNumTotalSamples );
+        
+        // only as many frames as fit
+        for( int f=0; f<s->numFrames && length < liveColumns; f++ ) {
+            length += snprintf( 
+                &( line[ length ] ), sizeof( line ) - length, 
+                f == 0 ? "%s" : " < %s",
+                getString( getLiveFuncName( &( s->frames[f] ) ) ) );
+            
+            if( length >= (int)sizeof( line ) ) {
+                length = sizeof( line ) - 1;
+                }
+            }
+        
+        addLiveLine( "%s", line );
         }
-    
-    char *stackStart = &( stackStartPos[ strlen( stackStartMarker ) ] );
-    
-    char *closeBracket = strstr( stackStart, "]\n" );
-    
-    if( closeBracket == NULL ) {
-        return;
+    }
+
+
+
+// called by the worker between samples
+static void drawLiveView( double inSampleTime ) {
+    if( liveResetRequested.exchange( false ) ) {
+        resetLiveView( inSampleTime );
         }
     
-    // terminate at close
-    closeBracket[0] = '\0';
+    int rows = 24;
+    liveColumns = 80;
     
-    const char *frameMarker = "frame=";
+    struct winsize size;
     
-    if( strstr( stackStart, frameMarker ) != stackStart ) {
-        return;
+    if( ioctl( STDOUT_FILENO, TIOCGWINSZ, &size ) == 0 && 
+        size.ws_row > 0 && size.ws_col > 0 ) {
+        rows = size.ws_row;
+        liveColumns = size.ws_col;
         }
     
-    // skip first
-    stackStart = &( stackStart[ strlen( frameMarker ) ] );
+    // one short, so the last line doesn't scroll the screen
+    liveRowsLeft = rows - 1;
     
-    int numFrames;
-    char **frames = split( stackStart, frameMarker, &numFrames );
-
-    Stack thisStack;
-    thisStack.sampleCount = 1;
-    for( int i=0; i<numFrames; i++ ) {
-        thisStack.frames.push_back( parseFrame( frames[i] ) );
-        delete [] frames[i];
-        }
-    delete [] frames;
-
+    liveText.deleteAll();
+    addLiveText( "\033[H" );
     
-    char match = false;
-    Stack insertedStack = thisStack;
+    // this view's count for each stack in stackLog
+    int *counts = new int[ stackLog.size() + 1 ];
+    int numStackSamples = 0;
     
     for( int i=0; i<stackLog.size(); i++ ) {
-        Stack *inOld = stackLog.getElement( i );
+        counts[i] = stackLog.getElementFast( i )->sampleCount;
         
-        if( stackCompare( inOld, &thisStack ) ) {
-            match = true;
-            inOld->sampleCount++;
-            insertedStack = *inOld;
-            break;
+        if( i < liveBaseCounts.size() ) {
+            counts[i] -= liveBaseCounts.getElementDirect( i );
             }
+        numStackSamples += counts[i];
         }
     
-    if( match ) {
-        freeStack( &thisStack );
+    int numSamples = numWorkerSamples - liveBaseSamples;
+    double seconds = ( inSampleTime - liveBaseTime ) / 1000000;
+    
+    if( seconds > 0 ) {
+        addLiveLine( "%d samples in %.1f seconds, %.1f per second "
+                     "(%.1f requested), target paused %.2f%% of the time",
+                     numSamples, seconds, numSamples / seconds,
+                     1000000 / minSampleInterval,
+                     100 * ( workerPauseTime - liveBasePauseTime ) / 
+                     ( seconds * 1000000 ) );
         }
     else {
-        stackLog.push_back( thisStack );
+        addLiveLine( "%d samples", numSamples );
+        }
+    
+    addLiveLine( "%d thread stacks sampled across %d thread names, "
+                 "%d unique stacks", 
+                 numStackSamples, threadLog.size(), stackLog.size() );
+    
+    addLiveLine( "f: functions   s: self   t: stacks   r: reset   "
+                 "q: stop and report" );
+    addLiveLine( "" );
+    
+    if( numStackSamples > 0 ) {
+        if( liveViewMode.load() == LIVE_STACKS ) {
+            drawLiveStacks( counts, numStackSamples );
+            }
+        else {
+            drawLiveFunctions( counts, numStackSamples,
+                               liveViewMode.load() == LIVE_SELF );
+            }
         }
+    
+    delete [] counts;
+    
+    // clear the rest of the screen
+    addLiveText( "\033[J" );
+    
+    fwrite( liveText.getElementFast( 0 ), 1, liveText.size(), stdout );
+    fflush( stdout );
+    }
 
-    // now look at roots of inserted stack
-    for( int i=1; 
-         i< insertedStack.frames.size() && 
-             i < NUM_ROOT_STACKS_TO_TRACK; 
-         i++ ) {
-        
-        Stack rootStack = getRoot( insertedStack, i );
-        
-        match = false;
+
+
+// run by the stdin thread in place of reading commands
+static void readLiveKeys() {
+    while( true ) {
+        char c;
+        int result = read( STDIN_FILENO, &c, 1 );
         
-        for( int r=0; r<stackRootLog[i].size(); r++ ) {
-            Stack *inOld = stackRootLog[i].getElement( r );
+        if( result == -1 && errno == EINTR ) {
+            continue;
+            }
+        if( result <= 0 ) {
+            // stdin closed, keep profiling until detatch_sec or program 
+            // exit
+            return;
+            }
         
-            if( stackCompare( inOld, &rootStack ) ) {
-                match = true;
-                inOld->sampleCount++;
+        switch( tolower( c ) ) {
+            case 'f':
+                liveViewMode = LIVE_FUNCTIONS;
                 break;
-                }
-            }
-    
-        if( !match ) {
-            stackRootLog[i].push_back( rootStack );
+            case 's':
+                liveViewMode = LIVE_SELF;
+                break;
+            case 't':
+                liveViewMode = LIVE_STACKS;
+                break;
+            case 'r':
+                liveResetRequested = true;
+                break;
+            case 'q':
+                programExited = true;
+                return;
             }
         }
     }
 
 
 
-void printStack( Stack inStack, int inNumTotalSamples ) {
-    Stack s = inStack;
+// takes single keys from the terminal, without echoing them, and 
+// switches to its alternate screen
+static void startLiveView() {
+    tcgetattr( STDIN_FILENO, &liveSavedTerminal );
+    
+    struct termios keys = liveSavedTerminal;
+    keys.c_lflag &= ~( ICANON | ECHO );
+    keys.c_cc[ VMIN ] = 1;
+    keys.c_cc[ VTIME ] = 0;
+    tcsetattr( STDIN_FILENO, TCSANOW, &keys );
+    
+    // alternate screen, cursor hidden
+    printf( "\033[?1049h\033[?25l" );
+    fflush( stdout );
     
-    printf( "%7.3f%% ===================================== (%d samples)\n"
-            "       %3d: %s   (at %s:%d)\n", 
-            100 * s.sampleCount / (float )inNumTotalSamples,
-            s.sampleCount,
-            1,
-            s.frames.getElement( 0 )->funcName, 
-            s.frames.getElement( 0 )->fileName, 
-            s.frames.getElement( 0 )->lineNum );
+    liveBaseTime = getMicroseconds();
+    
+    // first drawn after the first sample
+    nextLiveViewTime = 0;
+    }
+
+
 
-    StackFrame *sf = inStack.frames.getElement( 0 );
+static void freeLiveFrames() {
+    liveFrames.deleteAll();
     
-    if( sf->lineNum > 0 ) {
-        
-        char *listCommand = autoSprintf( "list %s:%d,%d",
-                                         sf->fileName,
-                                         sf->lineNum,
-                                         sf->lineNum );
-        sendCommand( listCommand );
-        
-        delete [] listCommand;
-        
-        char *response = getGDBResponse();
-        
-        char *marker = autoSprintf( "~\"%d\\t", sf->lineNum );
-        
-        char *markerSpot = strstr( response, marker );
-        
-        // if name present in line, it's a not-found error
-        if( markerSpot != NULL &&
-            strstr( markerSpot, sf->fileName ) == NULL ) {
-            char *lineStart = &( markerSpot[ strlen( marker ) ] );
-            
-            // trim spaces from start
-            while( lineStart[0] == ' ' ) {
-                lineStart = &( lineStart[1] );
-                }
-            
-            char *lineEnd = strstr( lineStart, "\\n" );
-            if( lineEnd != NULL ) {
-                lineEnd[0] ='\0';
-                }
-            printf( "            %d:|   %s\n", sf->lineNum, lineStart );
-            }
-        
-        delete [] marker;
-        delete [] response;
+    if( liveFrameSlots != NULL ) {
+        delete [] liveFrameSlots;
+        liveFrameSlots = NULL;
         }
+    numLiveFrameSlots = 0;
+    }
+
+
+
+// back to the screen we started on, for the report
+static void stopLiveView() {
+    printf( "\033[?25h\033[?1049l" );
+    fflush( stdout );
     
+    tcsetattr( STDIN_FILENO, TCSANOW, &liveSavedTerminal );
+    
+    liveBaseCounts.deleteAll();
+    liveText.deleteAll();
+    
+    freeLiveFrames();
+    }
 
-    // print stack for context below
-    for( int j=1; j<s.frames.size(); j++ ) {
-        StackFrame f = s.frames.getElementDirect( j );
-        printf( "       %3d: %s   (at %s:%d)\n", 
-                j + 1,
-                f.funcName, 
-                f.fileName, 
-                f.lineNum );
+
+
+// **************************************
+// windows, for staying attached indefinitely
+
+// with --window, each window's report is written to its own file in 
+// windowDir, by writeReportFile, and then everything logged in it is 
+// freed, so memory use doesn't grow with how long we've been attached
+// a window ends early if what's logged in it gets bigger than 
+// maxLogMemory
+// only the newest numWindowsToKeep files that we've written are kept
+
+
+// where window reports go, or NULL if we're not using windows
+char *windowDir = NULL;
+
+double windowSeconds = 60;
+
+// in bytes
+long maxLogMemory = 64L * 1024 * 1024;
+
+int numWindowsToKeep = 1440;
+
+// the files we've written that are still there, oldest first
+SimpleVector<char *> windowPaths;
+
+int numWindowsWritten = 0;
+
+
+
+// roughly what stackLog, callTree and threadLog are taking up
+// frame names aren't counted, since the string pool only grows with the 
+// names in the target, however long we sample it
+static long getLogMemory() {
+    long bytes = stackArena.fullBytes + stackArena.blockSize +
+        (long)stackLog.size() * sizeof( Stack ) +
+        (long)stackLogIndex.numSlots * sizeof( int ) +
+        (long)callTree.size() * sizeof( CallNode ) +
+        (long)numCallTreeSlots * sizeof( int ) +
+        (long)threadEntries.size() * sizeof( ThreadEntry ) +
+        (long)numThreadEntrySlots * sizeof( int );
+    
+    for( int i=0; i<threadLog.size(); i++ ) {
+        ThreadRecord *r = threadLog.getElementFast( i );
+        
+        bytes += (long)r->stacks.size() * sizeof( Stack ) +
+            (long)r->stackIndex.numSlots * sizeof( int );
         }
-    printf( "\n\n" );
+    return bytes;
     }
 
 
 
+// true if the current window is over, by time or by size
+static char windowIsOver( double inSampleTime ) {
+    if( inSampleTime >= windowStart.time + windowSeconds * 1000000 ) {
+        return true;
+        }
+    return maxLogMemory > 0 && getLogMemory() > maxLogMemory;
+    }
 
 
-int main( int inNumArgs, char **inArgs ) {
+
+// frees everything the window logged, and starts the next one
+static void releaseWindow( double inSampleTime ) {
+    freeStackIndex( &stackLogIndex );
+    freeThreadLog();
+    freeCallTree();
+    stackLog.deleteAll();
+    freeArena( &stackArena );
     
-    if( inNumArgs != 3 && inNumArgs != 4 && inNumArgs != 5 ) {
-        usage();
+    windowStart.time = inSampleTime;
+    windowStart.numSamples = numWorkerSamples;
+    windowStart.pauseTime = workerPauseTime;
+    windowStart.numTruncatedStacks = numTruncatedStacks;
+    windowStart.numDroppedStacks = numDroppedStacks;
+    
+    if( liveView ) {
+        // names are quick to look up again, and this keeps their table
+        // from growing too
+        freeLiveFrames();
+        resetLiveView( inSampleTime );
         }
+    }
+
+
+
+// writes the window that ends at inSampleTime to a new file, and drops
+// the oldest file if that's more than we keep
+static void writeWindow( double inSampleTime ) {
+    numWindowsWritten++;
     
-    float samplesPerSecond = 100;
+    time_t startTime = time( NULL ) - 
+        lrint( ( getMicroseconds() - windowStart.time ) / 1000000 );
     
-    sscanf( inArgs[1], "%f", &samplesPerSecond );
+    char startString[ 64 ];
+    strftime( startString, sizeof( startString ), "%Y%m%d-%H%M%S",
+              localtime( &startTime ) );
     
-
-
-    int readPipe[2];
-    int writePipe[2];
+    char *path = autoSprintf( "%s/profile-%s-%d.txt", windowDir, 
+                              startString, numWindowsWritten );
     
-    pipe( readPipe );
-    pipe( writePipe );
-
-
-    char *progName = stringDuplicate( inArgs[2] );
-    char *progArgs = stringDuplicate( "" );
+    char *header = autoSprintf( "Window %d, %.3f seconds of sampling "
+                                "from %s", 
+                                numWindowsWritten, 
+                                ( inSampleTime - windowStart.time ) / 
+                                1000000,
+                                startString );
     
-    char *spacePos = strstr( progName, " " );
+    writeReportFile( path, header, inSampleTime );
     
-    if( spacePos != NULL ) {
-        delete [] progArgs;
-        progArgs = stringDuplicate( &( spacePos[1] ) );
-        // cut off name at start of args
-        spacePos[0] = '\0';
-        }
+    delete [] header;
     
-
-    int childPID = fork();
+    windowPaths.push_back( path );
     
-    if( childPID == -1 ) {
-        printf( "Failed to fork\n" );
-        
-        delete [] progName;
-        delete [] progArgs;
-        
-        return 1;
+    while( windowPaths.size() > numWindowsToKeep ) {
+        char *oldest = windowPaths.getElementDirect( 0 );
+        unlink( oldest );
+        delete [] oldest;
+        windowPaths.deleteElement( 0 );
         }
-    else if( childPID == 0 ) {
-        // child
-        dup2( writePipe[0], STDIN_FILENO );
-        dup2( readPipe[1], STDOUT_FILENO );
-        dup2( readPipe[1], STDERR_FILENO );
+    }
 
-        while( false && true ) {
-            printf( "test\n" );
-            }
-        
-        //ask kernel to deliver SIGTERM in case the parent dies
-        prctl( PR_SET_PDEATHSIG, SIGTERM );
 
-        execlp( "gdb", "gdb", "-nx", "--interpreter=mi", progName, NULL );
-        
-        delete [] progName;
-        delete [] progArgs;
-        
-        exit( 0 );
+
+// called by the worker between samples
+static void checkWindow( double inSampleTime ) {
+    if( windowDir != NULL && windowIsOver( inSampleTime ) ) {
+        writeWindow( inSampleTime );
+        releaseWindow( inSampleTime );
         }
-    
-    // else parent
-    printf( "Forked GDB child on PID=%d\n", childPID );
-	
-	
-	char debugFileName[256];
-	scanf(debugFileName, "wcGDB.%s.log", inArgs[3]);
+    }
+
+
+
+static void freeWindowPaths() {
+    for( int i=0; i<windowPaths.size(); i++ ) {
+        delete [] windowPaths.getElementDirect( i );
+        }
+    windowPaths.deleteAll();
+    }
 
-	logFile = fopen(debugFileName, "w");
 
-	printf("Logging GDB commands and responses to %s\n", debugFileName);
+
+int main( int inNumArgs, char **inArgs ) {
     
+    // ID 0, for frames without names
+    internString( "" );
     
-    //close unused pipe ends
-    close( writePipe[0] );
-    close( readPipe[1] );
+    truncatedFrameNameID = internString( "[truncated]" );
+    
+    // pull options off the front, leaving the positional arguments
+    // where they've always been
+    int numOptionArgs = 0;
+    
+    while( 1 + numOptionArgs < inNumArgs &&
+           strstr( inArgs[ 1 + numOptionArgs ], "--" ) == 
+           inArgs[ 1 + numOptionArgs ] ) {
+        
+        char *option = inArgs[ 1 + numOptionArgs ];
+        char *value = NULL;
+        
+        if( 2 + numOptionArgs < inNumArgs ) {
+            value = inArgs[ 2 + numOptionArgs ];
+            }
+        
+        if( strcmp( option, "--backend" ) == 0 && value != NULL ) {
+            if( strcmp( value, "ptrace" ) == 0 ) {
+                useNativeBackend = true;
+                }
+            else if( strcmp( value, "gdb" ) == 0 ) {
+                useNativeBackend = false;
+                }
+            else {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--defer-symbols" ) == 0 ) {
+            deferSymbols = true;
+            numOptionArgs += 1;
+            }
+        else if( strcmp( option, "--non-stop" ) == 0 ) {
+            nonStopMode = true;
+            numOptionArgs += 1;
+            }
+        else if( strcmp( option, "--partial-depth" ) == 0 && 
+                 value != NULL ) {
+            if( sscanf( value, "%d", &partialStackDepth ) != 1 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--partial-threshold" ) == 0 && 
+                 value != NULL ) {
+            if( sscanf( value, "%d", &partialStackThreshold ) != 1 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--max-depth" ) == 0 && value != NULL ) {
+            if( sscanf( value, "%d", &maxStackDepth ) != 1 ||
+                maxStackDepth < 1 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--record" ) == 0 && value != NULL ) {
+            recordingPath = value;
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--snapshot" ) == 0 && value != NULL ) {
+            snapshotPath = value;
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--daemon" ) == 0 && value != NULL ) {
+            windowDir = value;
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--window" ) == 0 && value != NULL ) {
+            if( sscanf( value, "%lf", &windowSeconds ) != 1 ||
+                windowSeconds <= 0 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--max-memory" ) == 0 && value != NULL ) {
+            int megabytes;
+            if( sscanf( value, "%d", &megabytes ) != 1 || megabytes < 1 ) {
+                usage();
+                }
+            maxLogMemory = megabytes * 1024L * 1024L;
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--keep" ) == 0 && value != NULL ) {
+            if( sscanf( value, "%d", &numWindowsToKeep ) != 1 ||
+                numWindowsToKeep < 1 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--live" ) == 0 ) {
+            liveView = true;
+            numOptionArgs += 1;
+            }
+        else if( strcmp( option, "--snapshot-every" ) == 0 && 
+                 value != NULL ) {
+            if( sscanf( value, "%lf", &snapshotSeconds ) != 1 ||
+                snapshotSeconds <= 0 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--jitter" ) == 0 && value != NULL ) {
+            if( sscanf( value, "%d", &sampleJitterPercent ) != 1 ||
+                sampleJitterPercent < 0 || sampleJitterPercent > 50 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else if( strcmp( option, "--poisson" ) == 0 ) {
+            poissonSampling = true;
+            numOptionArgs += 1;
+            }
+        else if( strcmp( option, "--max-overhead" ) == 0 && 
+                 value != NULL ) {
+            if( sscanf( value, "%lf", &maxOverheadPercent ) != 1 ||
+                maxOverheadPercent <= 0 || maxOverheadPercent > 100 ) {
+                usage();
+                }
+            numOptionArgs += 2;
+            }
+        else {
+            usage();
+            }
+        }
     
-    inPipe = readPipe[0];
-    outPipe = writePipe[1];
-
-    fcntl( inPipe, F_SETFL, O_NONBLOCK );
-
-    char *gdbInitResponse = getGDBResponse();
+    inArgs = &( inArgs[ numOptionArgs ] );
+    inNumArgs -= numOptionArgs;
     
-    if( strstr( gdbInitResponse, "No such file or directory." ) != NULL ) {
-        delete [] gdbInitResponse;
-        printf( "GDB failed to start program '%s'\n", progName );
-        fclose( logFile );
-        logFile = NULL;
-        delete [] progName;
-        delete [] progArgs;
-        exit( 0 );
+    if( inNumArgs == 3 && strcmp( inArgs[1], "report" ) == 0 ) {
+        reportWithoutGDB = true;
+        
+        int result = reportRecording( inArgs[2] );
+        
+        freeSourceFiles();
+        freeStrings();
+        
+        return result;
         }
-    delete [] gdbInitResponse;
     
-
+    if( inNumArgs != 3 && inNumArgs != 4 && inNumArgs != 5 ) {
+        usage();
+        }
     
-    sendCommand( "handle SIGPIPE nostop noprint pass" );
+    if( nonStopMode && useNativeBackend ) {
+        printf( "--non-stop only applies to the GDB backend\n" );
+        usage();
+        }
     
-    skipGDBResponse();
+    if( liveView && 
+        ( ! isatty( STDIN_FILENO ) || ! isatty( STDOUT_FILENO ) ) ) {
+        printf( "--live needs a terminal\n" );
+        usage();
+        }
     
-
-
-    if( inNumArgs == 3 ) {
-        char *runCommand = autoSprintf( "run %s > wcOut.txt", progArgs );
-
-        printf( "\n\nStarting gdb program with '%s', "
-                "redirecting program output to wcOut.txt\n",
-                runCommand );
-        
-        sendCommand( runCommand );
-        delete [] runCommand;
+    if( windowDir != NULL && recordingPath != NULL ) {
+        // it would hold every window, and its tables would too
+        printf( "--record can't be used with --daemon\n" );
+        usage();
         }
-    else {
-        sendCommand( "-gdb-set target-async 1" );
-        skipGDBResponse();
-
-        printf( "\n\nAttaching to PID %s\n", inArgs[3] );
-
-        char *command = autoSprintf( "-target-attach %s\n", inArgs[3] );
-
-        sendCommand( command ); 
-
-        delete [] command;
-        
+    
+    if( windowDir != NULL ) {
+        pauseReportSinceStart = true;
         
-        char *gdbAttachResponse = getGDBResponse();
+        mkdir( windowDir, 0755 );
         
-        if( strstr( gdbAttachResponse, "ptrace: No such process." ) != NULL ) {
-            delete [] gdbAttachResponse;
-            printf( "GDB could not find process:  %s\n", inArgs[3] );
-            fclose( logFile );
-            logFile = NULL;
-            delete [] progName;
-            delete [] progArgs;
-            exit( 0 );
-            }
-        else if( strstr( gdbAttachResponse, 
-                         "ptrace: Operation not permitted." ) != NULL ) {
-            delete [] gdbAttachResponse;
-            printf( "GDB could not attach to process %s "
-                    "(maybe you need to be root?)\n", inArgs[3] );
-            fclose( logFile );
-            logFile = NULL;
-            delete [] progName;
-            delete [] progArgs;
-            exit( 0 );
+        if( access( windowDir, W_OK ) != 0 ) {
+            printf( "Can't write profiles to %s\n", windowDir );
+            return 1;
             }
-        
-        delete [] gdbAttachResponse;
-
-        printf( "\n\nResuming attached gdb program with '-exec-continue'\n" );
-        
-        sendCommand( "-exec-continue" );
         }
-
-    delete [] progArgs;
     
-    usleep( 100000 );
-
-    skipGDBResponse();
+    float samplesPerSecond = 100;
+    
+    sscanf( inArgs[1], "%f", &samplesPerSecond );
     
-    printf( "Debugging program '%s'\n", inArgs[2] );
 
-    char *endOfPath = strrchr( inArgs[2], '/' );
 
-    char *fullProgName = progName;
-    
-    if( endOfPath != NULL ) {
-        progName = &( endOfPath[1] );
+    if( recordingPath != NULL && 
+        ! startRecording( recordingPath, inArgs[2] ) ) {
+        printf( "Could not open %s to record samples to\n", 
+                recordingPath );
+        return 1;
         }
     
-    char *pidCall = autoSprintf( "pidof %s", progName );
-
-    delete [] fullProgName;
-
-    FILE *pidPipe = popen( pidCall, "r" );
+    char *progName = stringDuplicate( inArgs[2] );
+    char *progArgs = stringDuplicate( "" );
     
-    delete [] pidCall;
+    char *spacePos = strstr( progName, " " );
     
-    if( pidPipe == NULL ) {
-        printf( "Failed to open pipe to pidof to get debugged app pid\n" );
-        fclose( logFile );
-        logFile = NULL;
-        return 1;
+    if( spacePos != NULL ) {
+        delete [] progArgs;
+        progArgs = stringDuplicate( &( spacePos[1] ) );
+        // cut off name at start of args
+        spacePos[0] = '\0';
         }
+    
 
-    int pid = -1;
+    int pid;
     
-    // if there are multiple GDP procs, they are printed in newest-first order
-    // this will get the pid of the latest one (our GDB child)
-    int numRead = fscanf( pidPipe, "%d", &pid );
+    if( useNativeBackend ) {
+        // the native backend has no other way to name frames, and doing
+        // it per sample would only slow it down
+        deferSymbols = true;
+        
+        pid = startNativeTarget( inNumArgs, inArgs, progName, progArgs );
+        
+        delete [] progName;
+        delete [] progArgs;
+        }
+    else {
+        pid = startGDBTarget( inNumArgs, inArgs, progName, progArgs );
+        }
     
-    pclose( pidPipe );
-
-    if( numRead != 1 ) {
-        printf( "Failed to read PID of debugged app\n" );
-        fclose( logFile );
-        logFile = NULL;
+    if( pid == -1 ) {
         return 1;
         }
     
-    printf( "PID of debugged process = %d\n", pid );
+    if( deferSymbols && ! useNativeBackend ) {
+        // initial snapshot, refreshed as we see addresses outside of it
+        readMemoryRegions( pid );
+        }
     
 
     printf( "Sampling stack while program runs...\n" );
@@ -1682,6 +10645,9 @@ int main( int inNumArgs, char **inArgs ) {
     
     int numSamples = 0;
     
+    // one per thread per sample
+    int numStackSamples = 0;
+    
 
     int usPerSample = lrint( 1000000 / samplesPerSecond );
     
@@ -1689,23 +10655,71 @@ int main( int inNumArgs, char **inArgs ) {
     printf( "Sampling %.2f times per second, for %d usec between samples\n",
             samplesPerSecond, usPerSample );
     
-    time_t startTime = time( NULL );
+    if( maxOverheadPercent > 0 ) {
+        printf( "Sampling less often if needed to keep the target paused "
+                "for at most %g%% of the time\n", maxOverheadPercent );
+        }
+    
+    if( poissonSampling ) {
+        printf( "Samples are spaced randomly, at that average rate\n" );
+        }
+    else if( sampleJitterPercent > 0 ) {
+        printf( "Each sample is moved by up to %d%% of that, "
+                "earlier or later\n", sampleJitterPercent );
+        }
     
-    int detatchSeconds = -1;
+    double detatchSeconds = -1;
     
     if( inNumArgs == 5 ) {
-        sscanf( inArgs[4], "%d", &detatchSeconds );
+        sscanf( inArgs[4], "%lf", &detatchSeconds );
         }
-    if( detatchSeconds != -1 ) {
-        printf( "Will detatch automatically after %d seconds\n",
+    if( detatchSeconds >= 0 ) {
+        printf( "Will detatch automatically after %g seconds\n",
                 detatchSeconds );
         }
     
+    if( snapshotPath != NULL && snapshotSeconds < 0 ) {
+        snapshotSeconds = 10;
+        }
+    
+    if( snapshotPath != NULL ) {
+        printf( "Writing the report so far to %s every %g seconds\n",
+                snapshotPath, snapshotSeconds );
+        }
+    
+    if( windowDir != NULL ) {
+        printf( "Writing a profile to %s every %g seconds, or sooner if it "
+                "takes more than %ld MB, keeping the newest %d\n",
+                windowDir, windowSeconds, maxLogMemory / ( 1024 * 1024 ),
+                numWindowsToKeep );
+        }
+    
+    if( deferSymbols && 
+        ( liveView || snapshotPath != NULL || windowDir != NULL ) ) {
+        // so the worker doesn't stop to load them in the middle of 
+        // drawing the live view or writing a snapshot or window
+        printf( "Loading symbols\n" );
+        preloadDebugInfo = true;
+        loadMappedDebugInfo();
+        }
+    
+    if( liveView ) {
+        startLiveView();
+        }
+    
 	std::thread stdinThread([]() {
+		if (liveView) {
+			readLiveKeys();
+			return;
+		}
 		std::string s;
 		std::vector<std::string> exits = {"q", "exit", "stop", "quit"};
 		while (true) {
-			std::cin >> s;
+			if (!(std::cin >> s)) {
+				// stdin closed, keep profiling until detatch_sec
+				// or program exit
+				return;
+			}
 			for (char &c : s) {
 				c = tolower(c);
 			}
@@ -1723,10 +10737,71 @@ int main( int inNumArgs, char **inArgs ) {
 	});
 	stdinThread.detach();
 
-    while( !programExited &&
-           ( detatchSeconds == -1 ||
-             time( NULL ) < startTime + detatchSeconds ) ) {
-        usleep( usPerSample );
+    startSampleSchedule( samplesPerSecond );
+    
+    windowStart.time = sampleScheduleStartTime;
+    
+    if( snapshotSeconds > 0 ) {
+        nextSnapshotTime = sampleScheduleStartTime + 
+            snapshotSeconds * 1000000;
+        }
+    
+    startSamplePipeline();
+    
+    double samplingStartTime = sampleScheduleStartTime;
+    
+    double detatchTime = -1;
+    
+    if( detatchSeconds >= 0 ) {
+        detatchTime = samplingStartTime + detatchSeconds * 1000000;
+        }
+    
+    while( !programExited ) {
+        
+        double deadline = getNextSampleDeadline();
+        
+        if( detatchTime >= 0 && deadline >= detatchTime ) {
+            if( useNativeBackend ) {
+                runNativeTarget( detatchTime );
+                }
+            else {
+                sleepUntil( detatchTime );
+                }
+            break;
+            }
+        
+        if( useNativeBackend ) {
+            runNativeTarget( deadline );
+            
+            double pauseStart = getMicroseconds();
+            beginSample();
+            
+            if( !programExited && interruptNativeTarget() ) {
+                symbolTablesLock.lock();
+                numStackSamples += captureNativeStacks();
+                symbolTablesLock.unlock();
+                numSamples++;
+                
+                continueNativeTarget();
+                
+                logPause( pauseStart );
+                }
+            endSample();
+            continue;
+            }
+        
+        sleepUntil( deadline );
+        
+        if( nonStopMode ) {
+            beginSample();
+            numStackSamples += sampleGDBThreadsNonStop();
+            numSamples++;
+            endSample();
+            continue;
+            }
+        
+        double pauseStart = getMicroseconds();
+        beginSample();
     
         // interrupt
         if( inNumArgs == 3 ) {
@@ -1744,27 +10819,37 @@ int main( int inNumArgs, char **inArgs ) {
         
 
         if( !programExited ) {
-            // sample stack
-            sendCommand( "-stack-list-frames" );
-            logGDBStackResponse();
+            // sample every thread's stack, and continue running
+            numStackSamples += sampleGDBThreads( pauseStart );
             numSamples++;
             }
-        
-        if( !programExited ) {
-            // continue running
-            
-            sendCommand( "-exec-continue" );
-            skipGDBResponse();
-            }
+        endSample();
+        }
+
+    double samplingSeconds = 
+        ( getMicroseconds() - samplingStartTime ) / 1000000;
+    
+    stopSamplePipeline();
+    
+    if( liveView ) {
+        stopLiveView();
         }
 
     if( programExited ) {
         printf( "Program exited normally\n" );
         }
+    else if( useNativeBackend ) {
+        printf( "Detatching from program\n" );
+        
+        detachNativeTarget();
+        }
     else {
         printf( "Detatching from program\n" );
         
-        if( inNumArgs == 3 ) {
+        if( nonStopMode ) {
+            sendCommand( "-exec-interrupt --all" );
+            }
+        else if( inNumArgs == 3 ) {
             // we ran our program with run above to redirect output
             // thus -exec-interrupt won't work
             log( "Sending SIGINT to target process", inArgs[2] );
@@ -1784,180 +10869,82 @@ int main( int inNumArgs, char **inArgs ) {
         detatchJustSent = false;
         }
     
-    printf( "%d stack samples taken\n", numSamples );
-
-    printf( "%d unique stacks sampled\n", stackLog.size() );
-
-
-    SimpleVector<FunctionRecord> functions;
+    SamplingSummary summary;
+    summary.numSamples = numSamples;
+    summary.numStackSamples = numStackSamples;
+    summary.samplingSeconds = samplingSeconds;
+    summary.samplesPerSecond = samplesPerSecond;
+    summary.pauseTime = totalPauseTime;
+    summary.numTruncatedStacks = numTruncatedStacks;
+    summary.numDroppedStacks = numDroppedStacks;
     
-    for( int i=0; i<stackLog.size(); i++ ) {
-        Stack *s = stackLog.getElement( i );
-        
-        int sampleCount = s->sampleCount;
+    if( windowDir != NULL ) {
+        // the last window, cut short
+        writeWindow( samplingStartTime + samplingSeconds * 1000000 );
         
-        for( int f=0; f< s->frames.size(); f++ ) {
-            char *funcName = s->frames.getElement( f )->funcName;
-            
-            char found = false;
-            for (int fdup = 0; fdup < f; fdup++) {
-                char *dupFuncName = s->frames.getElement(fdup)->funcName;
-                if (strcmp(funcName, dupFuncName) == 0) {
-                    // this function was already reported by this stack
-                    found = true;
-                    break;
-                    }
-                }
-            if (found) {
-                continue;
-                }
-
-            found = false;
-            for( int r=0; r<functions.size(); r++ ) {
-                if( strcmp( functions.getElement( r )->funcName,
-                            funcName ) == 0 ) {
-                    // hit
-                    found = true;
-                    functions.getElement( r )->sampleCount += sampleCount;
-                    break;
-                    }
-                }
-            if( !found ) {
-                FunctionRecord newFunc = { funcName, sampleCount };
-                functions.push_back( newFunc );
-                }
-            }
+        printf( "%d samples taken over %.3f seconds\n", 
+                numSamples, samplingSeconds );
+        printf( "%d windows written to %s, the newest %d of them kept\n",
+                numWindowsWritten, windowDir, windowPaths.size() );
+        printPauseReport();
         }
-    
-    SimpleVector<FunctionRecord> sortedFunctions;
-    while( functions.size() > 0 ) {
-        int max = 1;
-        FunctionRecord maxFunc;
-        int maxInd = -1;
-        for( int i=0; i<functions.size(); i++ ) {
-            FunctionRecord r = functions.getElementDirect( i );
-            
-            if( r.sampleCount > max ) {
-                maxFunc = r;
-                max = r.sampleCount;
-                maxInd = i;
-                }
-            }  
-        if( maxInd >= 0 ) {
-            sortedFunctions.push_back( maxFunc );
-            functions.deleteElement( maxInd );
-            }
-        else {
-            break;
-            }
+    else {
+        printSamplingSummary( &summary );
         }
     
+    printf( "%ld operator new calls while sampling, %ld of them in the %d "
+            "samples that found no new stacks or threads\n",
+            numSampleAllocations, numSteadySampleAllocations, 
+            numSteadySamples );
     
+    // no more samples to match
+    freeStackIndex( &stackLogIndex );
     
-    // simple insertion sort
-    SimpleVector<Stack> sortedStacks;
-    
-    while( stackLog.size() > 0 ) {
-        int max = 0;
-        Stack maxStack;
-        int maxInd = -1;
-        for( int i=0; i<stackLog.size(); i++ ) {
-            Stack s = stackLog.getElementDirect( i );
-            
-            if( s.sampleCount > max ) {
-                maxStack = s;
-                max = s.sampleCount;
-                maxInd = i;
-                }
-            }  
-        if( maxInd >= 0 ) {
-            sortedStacks.push_back( maxStack );
-            stackLog.deleteElement( maxInd );
+    if( windowDir == NULL ) {
+        if( deferSymbols ) {
+            resolveDeferredSymbols();
             }
-        else {
-            break;
-            }
-        }
-
-
-    SimpleVector<Stack> sortedRootStacks[ NUM_ROOT_STACKS_TO_TRACK ];
-    
-    for( int r=1; r<NUM_ROOT_STACKS_TO_TRACK; r++ ) {
         
-        while( stackRootLog[r].size() > 0 ) {
-            int max = 1;
-            Stack maxStack;
-            int maxInd = -1;
-            for( int i=0; i<stackRootLog[r].size(); i++ ) {
-                Stack s = stackRootLog[r].getElementDirect( i );
-            
-                if( s.sampleCount > max ) {
-                    maxStack = s;
-                    max = s.sampleCount;
-                    maxInd = i;
-                    }
-                }  
-            if( maxInd >= 0 ) {        
-                sortedRootStacks[r].push_back( maxStack );
-                stackRootLog[r].deleteElement( maxInd );
-                }
-            else {
-                break;
-                }
+        if( recordingFile != NULL ) {
+            finishRecording( &summary );
             }
         
+        printReport( numStackSamples );
         }
     
+    freeWindowPaths();
     
-    printf( "\n\n\nReport:\n\n" );
-
-    printf( "\n\n\nFunctions "
-            "with more than one sample:\n\n" );
-
-    for( int i=0; i<sortedFunctions.size(); i++ ) {
-        FunctionRecord f = sortedFunctions.getElementDirect( i );
-        
-        printf( "%7.3f%% ===================================== (%d samples)\n"
-                "         %s\n\n\n",
-                100 * f.sampleCount / (float )numSamples,
-                f.sampleCount,
-                f.funcName );
-        }
-                
-
-
-    for( int r=1; r<NUM_ROOT_STACKS_TO_TRACK; r++ ) {
-        if( sortedRootStacks[r].size() > 0 ) {
-            
-            printf( "\n\n\nPartial stacks of depth [%d] "
-                    "with more than one sample:\n\n", r );
-            
-            for( int i=0; i<sortedRootStacks[r].size(); i++ ) {
-                Stack s = sortedRootStacks[r].getElementDirect( i );
-                printStack( s, numSamples );
-                }
-            }
-        }
+    freeThreadLog();
     
+    freeCallTree();
     
-    printf( "\n\n\nFull stacks "
-            "with at least one sample:\n\n" );
+    stackLog.deleteAll();
+    freeArena( &stackArena );
+    for( int i=0; i<2; i++ ) {
+        freeArena( &( gdbThreadLists[i].names ) );
+        }
+    freeArena( &workerArena );
     
-    for( int i=0; i<sortedStacks.size(); i++ ) {
-        Stack s = sortedStacks.getElementDirect( i );
-        printStack( s, numSamples );
-        
-        freeStack( &s );
+    if( nativeFramePCs != NULL ) {
+        delete [] nativeFramePCs;
+        delete [] nativeFrameIsCaller;
         }
-
-    // stacks that had only one sample
-    for( int i=0; i<stackLog.size(); i++ ) {
-        Stack s = stackLog.getElementDirect( i );
-        freeStack( &s );
+    
+    if( readBuff != NULL ) {
+        delete [] readBuff;
         }
     
-    fclose( logFile );
-    logFile = NULL;
+    freeNativeThreads();
+    
+    freeResolvedFrames();
+    
+    freeSourceFiles();
+    
+    freeStrings();
+    
+    freeElfFiles();
+    
+    closeLogFile();
         
     
     return 0;